@@ -0,0 +1,84 @@
+#ifndef BIT_PACK_H
+#define BIT_PACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Packing of integers into the given number of bits each, lowest bits first.
+// Used by the data codecs (HitCodec) for blocks of values of similar
+// magnitude.
+namespace bitpack {
+
+// Number of bits needed for the largest of the values
+inline unsigned width(const uint64_t* values, size_t n) {
+  uint64_t bits = 0;
+  for (size_t i = 0; i < n; ++i) bits |= values[i];
+  return bits ? 64 - __builtin_clzll(bits) : 0;
+}
+
+// Size of `n` packed values of `width` bits, bytes
+inline size_t size(size_t n, unsigned width) {
+  return (n * width + 7) / 8;
+}
+
+// Writes `n` values of at most `width` bits. Returns the end of the written
+// data (size(n, width) bytes).
+inline uint8_t* pack(
+    const uint64_t* values, size_t n, unsigned width, uint8_t* out
+) {
+  if (width == 0) return out;
+  uint64_t word = 0;
+  unsigned bits = 0; // used in word
+  for (size_t i = 0; i < n; ++i) {
+    word |= values[i] << bits;
+    bits += width;
+    if (bits >= 64) {
+      std::memcpy(out, &word, sizeof(word));
+      out  += sizeof(word);
+      bits -= 64;
+      // the bits of the value which did not fit
+      word = bits ? values[i] >> (width - bits) : 0;
+    };
+  };
+  size_t tail = (bits + 7) / 8;
+  std::memcpy(out, &word, tail);
+  return out + tail;
+}
+
+// Reads `n` values of `width` bits written by pack. Returns the end of the
+// read data.
+inline const uint8_t* unpack(
+    const uint8_t* in, size_t n, unsigned width, uint64_t* values
+) {
+  if (width == 0) {
+    for (size_t i = 0; i < n; ++i) values[i] = 0;
+    return in;
+  };
+  const uint8_t* end = in + size(n, width);
+  uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+  uint64_t word = 0;
+  unsigned bits = 0; // left in word
+  for (size_t i = 0; i < n; ++i) {
+    if (bits >= width) {
+      values[i] = word & mask;
+      word = width == 64 ? 0 : word >> width;
+      bits -= width;
+      continue;
+    };
+    uint64_t next = 0;
+    size_t   left = end - in;
+    std::memcpy(&next, in, left < sizeof(next) ? left : sizeof(next));
+    in += sizeof(next);
+    values[i] = (word | next << bits) & mask;
+    // bits of `next` consumed by values[i]
+    unsigned used = width - bits;
+    word = used == 64 ? 0 : next >> used;
+    bits = 64 - used;
+  };
+  return end;
+}
+
+}; // namespace bitpack
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef CHANNEL_MASK_H
+#define CHANNEL_MASK_H
+
+#include <atomic>
+#include <cstdint>
+
+// Set of values of Hit::channel. Can be updated while being read by other
+// threads.
+class ChannelMask {
+  public:
+    ChannelMask() {
+      for (auto& word : bits) word = 0;
+    };
+
+    void set(uint8_t channel) {
+      bits[channel >> 6].fetch_or(
+          uint64_t(1) << (channel & 63), std::memory_order_relaxed
+      );
+    };
+
+    bool test(uint8_t channel) const {
+      return bits[channel >> 6].load(std::memory_order_relaxed)
+           >> (channel & 63) & 1;
+    };
+
+    bool empty() const {
+      for (auto& word : bits)
+        if (word.load(std::memory_order_relaxed)) return false;
+      return true;
+    };
+
+    void clear() {
+      for (auto& word : bits) word.store(0, std::memory_order_relaxed);
+    };
+
+  private:
+    std::atomic<uint64_t> bits[4];
+};
+
+#endif
@@ -1,7 +1,67 @@
+#include <thread>
+
 #include "DataModel.h"
 
 DataModel::DataModel(){}
 
+TimeSlice* DataModel::take_timeslice(
+    trigger_type type, std::chrono::milliseconds timeout
+) {
+  std::unique_lock<std::mutex> lock(trigger_queues_mutex);
+  auto& queue = trigger_queues[type];
+  if (!trigger_queues_cv.wait_for(
+        lock, timeout, [&queue]() { return !queue.empty(); }
+      ))
+    return nullptr;
+  TimeSlice* timeslice = queue.front();
+  queue.pop();
+  return timeslice;
+}
+
+void DataModel::trigger_done(TimeSlice* timeslice, trigger_type) {
+  // acq_rel: the last trigger sees the lanes written by the others
+  if (timeslice->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+  // All triggers are done
+  std::unique_ptr<TimeSlice> slice(timeslice);
+  if (!event_building) {
+    if (writing) slice->merge_triggers();
+    write_timeslice(std::move(slice));
+    return;
+  };
+
+  slice->merge_triggers();
+  {
+    std::lock_guard<std::mutex> lock(event_queue_mutex);
+    event_queue.push(std::move(slice));
+  };
+  event_queue_cv.notify_one();
+}
+
+void DataModel::write_timeslice(std::unique_ptr<TimeSlice> timeslice) {
+  bool discarded = false;
+  while (writing && write_limit.full()) {
+    if (write_limit.policy != QueueLimit::Policy::block) {
+      write_limit.discard(*timeslice);
+      discarded = true;
+      break;
+    };
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  };
+  if (!writing || discarded) {
+    timeslice->clear();
+    timeslices.put(std::move(timeslice));
+    return;
+  };
+
+  write_limit.add(*timeslice);
+  {
+    std::lock_guard<std::mutex> lock(write_queue_mutex);
+    write_queue.push(std::move(timeslice));
+  };
+  write_queue_cv.notify_one();
+}
+
 /*
 TTree* DataModel::GetTTree(std::string name){
 
@@ -1,6 +1,9 @@
 #ifndef DATAMODEL_H
 #define DATAMODEL_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <map>
 #include <string>
 #include <vector>
@@ -15,6 +18,12 @@
 #include "DAQUtilities.h"
 #include "TimeSlice.h"
 #include "Hit.h"
+#include "ChannelMask.h"
+#include "Executor.h"
+#include "Pool.h"
+#include "QueueLimit.h"
+#include "RawReadout.h"
+#include "TriggerJobs.h"
 
 
 #include <zmq.hpp>
@@ -44,22 +53,85 @@ class DataModel : public DAQDataModelBase {
   //void AddTTree(std::string name,TTree *tree);
   //void DeleteTTree(std::string name,TTree *tree);
   
-  std::queue<TimeSlice*> pre_sort_queue;
-  std::map<trigger_type, std::queue<TimeSlice*> > trigger_queues;
-
   // True if the corresponding digitizer is active (no communication error
   // experienced). The stored values are actually booleans, but we cannot use
   // std::vector<bool> here because we need to be able to take addresses of its
   // elements.
   std::vector<uint8_t> active_digitizers;
 
-  // Readout of the digitizer data in the CAEN data format
-  std::unique_ptr<std::list<std::unique_ptr<std::vector<Hit>>>> raw_readout;
-  std::mutex raw_readout_mutex;
-
-  // Readout reformatted in terms of timeslices and hits
-  std::queue<std::unique_ptr<TimeSlice>> readout;
-  std::mutex readout_mutex;
+  // Readout of the digitizer data in the CAEN data format, one queue per
+  // readout thread
+  RawReadout raw_readout;
+  // Hits in raw_readout and held by its consumer. Set by the Digitizer.
+  QueueLimit raw_readout_limit;
+
+  // Recycled hit blocks for raw_readout. The consumer of raw_readout returns
+  // the emptied blocks here.
+  Pool<HitBlock> hit_blocks;
+
+  // Readout reformatted in terms of timeslices and hits, produced by the
+  // Reformatter and consumed by the Sorter. Hits in a timeslice are in time
+  // order. pre_sort_cv is notified on push.
+  std::queue<std::unique_ptr<TimeSlice>> pre_sort_queue;
+  std::mutex pre_sort_mutex;
+  std::condition_variable pre_sort_cv;
+  // Hits in pre_sort_queue. Set by the Reformatter; the consumer of
+  // pre_sort_queue removes the timeslices it takes.
+  QueueLimit pre_sort_limit;
+
+  // Sorted timeslices waiting for each trigger. A timeslice is pushed into
+  // the queues of all triggers set in TimeSlice::triggers.
+  std::map<trigger_type, std::queue<TimeSlice*> > trigger_queues;
+  std::mutex trigger_queues_mutex;
+  std::condition_variable trigger_queues_cv;
+
+  // Channels (Hit::channel) fed by the calibration pulser. Set by
+  // CalibTrigger. The Sorter pushes into trigger_queues[trigger_type::calib]
+  // only the timeslices with hits in these channels.
+  ChannelMask calib_channels;
+
+  // Timeslices processed by all triggers, with TimeSlice::positive_trggers
+  // filled, for the EventBuilder. Used only when event_building is set (by
+  // the EventBuilder); otherwise the timeslices go to write_queue.
+  std::queue<std::unique_ptr<TimeSlice>> event_queue;
+  std::mutex event_queue_mutex;
+  std::condition_variable event_queue_cv;
+  std::atomic<bool> event_building {false};
+
+  // Timeslices to be stored by the DataWriter, after event building if the
+  // EventBuilder is running. Used only when writing is set (by the
+  // DataWriter); otherwise the timeslices are discarded.
+  std::queue<std::unique_ptr<TimeSlice>> write_queue;
+  std::mutex write_queue_mutex;
+  std::condition_variable write_queue_cv;
+  std::atomic<bool> writing {false};
+  // Hits in write_queue and held by the DataWriter. Set by the DataWriter,
+  // which removes the timeslices once written. The Sorter releases the
+  // timeslices from pre_sort_limit as it takes them, so this is what bounds
+  // the timeslices between the triggers and the disk.
+  QueueLimit write_limit;
+
+  // Recycled timeslices. The last consumer of a timeslice clears it and
+  // returns it here.
+  Pool<TimeSlice> timeslices;
+
+  // Takes a timeslice from trigger_queues[type], waiting up to `timeout` for
+  // one. Returns nullptr on timeout.
+  TimeSlice* take_timeslice(trigger_type type, std::chrono::milliseconds timeout);
+
+  // Marks the timeslice as processed by the trigger. The last trigger to
+  // process the timeslice passes it on to event_queue or write_queue.
+  void trigger_done(TimeSlice* timeslice, trigger_type type);
+
+  // Passes the timeslice to write_queue, or recycles it if no DataWriter is
+  // running. At a write_limit watermark, waits for the DataWriter or
+  // discards the timeslice according to the policy.
+  void write_timeslice(std::unique_ptr<TimeSlice> timeslice);
+
+  // Worker threads shared by the processing tools (Sorter and triggers).
+  // Declared last so that it stops, completing the queued jobs, before the
+  // rest of the data model is destroyed.
+  Executor executor;
 
 private:
 
@@ -0,0 +1,144 @@
+#include <stdexcept>
+
+#include "Executor.h"
+
+thread_local const Executor* Executor::pool = nullptr;
+thread_local int             Executor::self = -1;
+
+static uint64_t nanoseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+void Executor::Stats::report(
+    ToolFramework::Store& data, const std::string& prefix
+) const {
+  data.Set(prefix + "_jobs",      jobs.load());
+  data.Set(prefix + "_errors",    errors.load());
+  data.Set(prefix + "_run_time",  run_time.load()  * 1e-9);
+  data.Set(prefix + "_wait_time", wait_time.load() * 1e-9);
+}
+
+void Executor::start(unsigned threads) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!workers.empty()) return;
+
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+
+  quit = false;
+  for (unsigned i = 0; i < threads; ++i)
+    workers.push_back(std::unique_ptr<Worker>(new Worker));
+  nworkers = threads;
+  for (unsigned i = 0; i < threads; ++i)
+    workers[i]->thread = std::thread(&Executor::run, this, i);
+}
+
+void Executor::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (workers.empty()) return;
+    quit = true;
+  };
+  cv.notify_all();
+  for (auto& worker : workers) worker->thread.join();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  workers.clear();
+  nworkers = 0;
+}
+
+void Executor::submit(Job job, Stats* stats, bool urgent_job) {
+  unsigned n = nworkers;
+  if (n == 0) throw std::runtime_error("Executor: the pool is not running");
+
+  Task task;
+  task.job       = std::move(job);
+  task.stats     = stats;
+  task.submitted = std::chrono::steady_clock::now();
+
+  if (urgent_job) {
+    std::lock_guard<std::mutex> lock(urgent_mutex);
+    urgent.push_back(std::move(task));
+  } else {
+    Worker& worker = *workers[pool == this ? self : next++ % n];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+  };
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++queued;
+  };
+  cv.notify_one();
+}
+
+// Takes an urgent job, a job from the worker's own deque, or steals one
+bool Executor::take(unsigned worker, Task& task) {
+  {
+    std::lock_guard<std::mutex> lock(urgent_mutex);
+    if (!urgent.empty()) {
+      task = std::move(urgent.front());
+      urgent.pop_front();
+      return true;
+    };
+  };
+
+  {
+    Worker& own = *workers[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    };
+  };
+
+  unsigned n = workers.size();
+  for (unsigned i = 1; i < n; ++i) {
+    Worker& victim = *workers[(worker + i) % n];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    };
+  };
+
+  return false;
+}
+
+void Executor::run(unsigned worker) {
+  pool = this;
+  self = worker;
+  while (true) {
+    {
+      // Reserve a job. Jobs are queued before they are counted, so a reserved
+      // job is always found in some deque.
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this]() { return quit || queued > 0; });
+      if (queued == 0) break; // quit
+      --queued;
+    };
+
+    Task task;
+    while (!take(worker, task)) std::this_thread::yield();
+
+    auto start = std::chrono::steady_clock::now();
+    bool failed = false;
+    try {
+      task.job();
+    } catch (...) {
+      failed = true;
+    };
+
+    if (task.stats) {
+      auto end = std::chrono::steady_clock::now();
+      ++task.stats->jobs;
+      if (failed) ++task.stats->errors;
+      task.stats->run_time  += nanoseconds(end - start);
+      task.stats->wait_time += nanoseconds(start - task.submitted);
+    };
+  };
+  pool = nullptr;
+  self = -1;
+}
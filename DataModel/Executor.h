@@ -0,0 +1,91 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Store.h"
+
+// Pool of worker threads shared by the processing tools. Each worker has its
+// own job deque: jobs submitted by a worker go to its own deque and are taken
+// from the back (most recent first), idle workers steal from the front of the
+// others' deques. Jobs submitted from outside of the pool are distributed
+// round robin. Idle workers sleep on a condition variable.
+//
+// The number of threads is set by the first call to start; later calls have
+// no effect, so that the tools sharing the pool cannot multiply the threads.
+class Executor {
+  public:
+    typedef std::function<void()> Job;
+
+    // Per-client counters, updated as the jobs complete
+    struct Stats {
+      std::atomic<uint64_t> jobs      {0};
+      std::atomic<uint64_t> errors    {0}; // jobs that threw an exception
+      std::atomic<uint64_t> run_time  {0}; // total job run time, ns
+      std::atomic<uint64_t> wait_time {0}; // total time from submit to run, ns
+
+      // Reports the counters as <prefix>_<name>
+      void report(ToolFramework::Store& data, const std::string& prefix) const;
+    };
+
+    ~Executor() { stop(); };
+
+    // Starts the worker threads; 0 means the number of hardware threads.
+    // Does nothing if the pool is running already.
+    void start(unsigned threads = 0);
+
+    // Runs the queued jobs and stops the worker threads
+    void stop();
+
+    // Number of worker threads
+    unsigned size() const { return nworkers; };
+
+    // Queues a job. Thread safe. The pool must be running. A job must not
+    // block waiting for other jobs. Urgent jobs are taken by the workers
+    // before all others, in the order of submission.
+    void submit(Job job, Stats* stats = nullptr, bool urgent = false);
+
+  private:
+    struct Task {
+      Job    job;
+      Stats* stats;
+      std::chrono::steady_clock::time_point submitted;
+    };
+
+    struct Worker {
+      std::mutex       mutex;
+      std::deque<Task> tasks;
+      std::thread      thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::mutex       urgent_mutex;
+    std::deque<Task> urgent;
+    std::atomic<unsigned> nworkers {0};
+    std::atomic<unsigned> next     {0}; // round robin for external jobs
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    size_t                  queued = 0; // jobs not yet taken by a worker
+    bool                    quit   = false;
+
+    // the pool and the index of the worker running on this thread
+    static thread_local const Executor* pool;
+    static thread_local int             self;
+
+    bool take(unsigned worker, Task& task);
+    void run(unsigned worker);
+};
+
+#endif
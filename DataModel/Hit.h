@@ -2,18 +2,57 @@
 #define HIT_H
 
 #include <cstdint>
+#include <vector>
 
+// Hit is a trivially copyable POD. Its waveform (if any) is stored in the
+// samples arena of the HitBlock containing the hit.
 struct Hit {
   uint64_t time;
+  uint32_t waveform_offset; // index of the first sample in HitBlock::waveforms
   uint16_t charge_short;
   uint16_t charge_long;
   uint16_t baseline;
+  uint16_t waveform_length; // number of samples, 0 if there is no waveform
   uint8_t  channel; // (digitizer channel) | (digitizer id) << 4
-  std::vector<uint16_t> waveform;
 
   static uint8_t get_digitizer_id(uint8_t channel) {
     return channel >> 4;
   };
+
+  // Hit time (as decoded by the Reformatter) is measured in 1/1024 of the
+  // 2 ns sampling period
+  static uint64_t time_from_ns(double ns) {
+    return static_cast<uint64_t>(ns * 512);
+  };
+};
+
+// Hits with their waveforms stored contiguously in one buffer, so that a
+// block costs a constant number of allocations regardless of the number of
+// hits
+struct HitBlock {
+  std::vector<Hit>      hits;
+  std::vector<uint16_t> waveforms; // samples of all waveforms
+
+  const uint16_t* waveform(const Hit& hit) const {
+    return waveforms.data() + hit.waveform_offset;
+  };
+
+  // Append a hit with its waveform samples taken from `samples`
+  // (hit.waveform_length long)
+  void push_back(Hit hit, const uint16_t* samples) {
+    if (hit.waveform_length) {
+      hit.waveform_offset = waveforms.size();
+      waveforms.insert(
+          waveforms.end(), samples, samples + hit.waveform_length
+      );
+    };
+    hits.push_back(hit);
+  };
+
+  void clear() {
+    hits.clear();
+    waveforms.clear();
+  };
 };
 
 #endif
@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "BitPack.h"
+#include "HitCodec.h"
+
+namespace {
+
+// values per bit-packed block
+const size_t block_size = 128;
+
+inline uint64_t zigzag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+inline uint8_t* put_varint(uint8_t* p, uint64_t value) {
+  while (value >= 0x80) {
+    *p++ = static_cast<uint8_t>(value) | 0x80;
+    value >>= 7;
+  };
+  *p++ = static_cast<uint8_t>(value);
+  return p;
+}
+
+inline size_t varint_size(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  };
+  return size;
+}
+
+void malformed() {
+  throw std::runtime_error("HitCodec: malformed column");
+}
+
+// Reads a column, checking its bounds
+struct Reader {
+  const uint8_t* p;
+  const uint8_t* end;
+
+  uint8_t byte() {
+    if (p == end) malformed();
+    return *p++;
+  };
+
+  uint64_t varint() {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64 && p != end; shift += 7) {
+      uint8_t byte = *p++;
+      value |= uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return value;
+    };
+    malformed();
+    return 0;
+  };
+
+  // Reads a block of `n` packed values
+  void block(size_t n, uint64_t* values) {
+    unsigned width = byte();
+    if (width > 64 || static_cast<size_t>(end - p) < bitpack::size(n, width))
+      malformed();
+    p = bitpack::unpack(p, n, width, values);
+  };
+};
+
+// Locates the columns of the encoded hits
+struct Columns {
+  Reader column[HitCodec::columns];
+
+  Columns(const uint8_t* data, size_t size) {
+    size_t offset = HitCodec::columns * sizeof(uint32_t);
+    if (size < offset) throw std::runtime_error("HitCodec: truncated hits");
+    for (int i = 0; i < HitCodec::columns; ++i) {
+      uint32_t length;
+      std::memcpy(&length, data + i * sizeof(uint32_t), sizeof(length));
+      if (size - offset < length)
+        throw std::runtime_error("HitCodec: truncated hits");
+      column[i].p   = data + offset;
+      column[i].end = data + offset + length;
+      offset += length;
+    };
+  };
+};
+
+// Appends `n` values `value(i)` to `out` in packed blocks: the width of the
+// block values in bits (one byte), then the packed values. Returns the
+// number of bytes appended.
+template <typename Value>
+size_t encode_values(std::vector<uint8_t>& out, size_t n, Value value) {
+  size_t start = out.size();
+  uint64_t values[block_size];
+  for (size_t i = 0; i < n; i += block_size) {
+    size_t m = std::min(block_size, n - i);
+    for (size_t j = 0; j < m; ++j) values[j] = value(i + j);
+    unsigned width = bitpack::width(values, m);
+    size_t end = out.size();
+    out.resize(end + 1 + bitpack::size(m, width));
+    out[end] = width;
+    bitpack::pack(values, m, width, out.data() + end + 1);
+  };
+  return out.size() - start;
+}
+
+// Reads `n` values written by encode_values and passes them to
+// `store(i, value)`
+template <typename Store>
+void decode_values(Reader& column, size_t n, Store store) {
+  uint64_t values[block_size];
+  for (size_t i = 0; i < n; i += block_size) {
+    size_t m = std::min(block_size, n - i);
+    column.block(m, values);
+    for (size_t j = 0; j < m; ++j) store(i + j, values[j]);
+  };
+}
+
+void decode_times(Reader& column, size_t nhits, uint64_t* times) {
+  if (nhits == 0) return;
+  uint64_t last = column.varint();
+  decode_values(
+      column, nhits,
+      [times, &last](size_t i, uint64_t value) {
+        last += unzigzag(value);
+        times[i] = last;
+      }
+  );
+}
+
+void decode_charges(Reader& column, size_t nhits, uint16_t* charges) {
+  decode_values(
+      column, nhits,
+      [charges](size_t i, uint64_t value) { charges[i] = value; }
+  );
+}
+
+void decode_channels(Reader& column, size_t nhits, uint8_t* channels) {
+  if (nhits == 0) return;
+  if (column.byte() == 0) {
+    decode_values(
+        column, nhits,
+        [channels](size_t i, uint64_t value) { channels[i] = value; }
+    );
+    return;
+  };
+  // runs
+  size_t i = 0;
+  while (i < nhits) {
+    uint8_t  channel = column.byte();
+    uint64_t length  = column.varint() + 1;
+    if (length > nhits - i) malformed();
+    std::memset(channels + i, channel, length);
+    i += length;
+  };
+}
+
+void decode_baselines(
+    Reader& column, size_t nhits, const uint8_t* channels, uint16_t* baselines
+) {
+  uint16_t last[256] = {};
+  decode_values(
+      column, nhits,
+      [channels, baselines, &last](size_t i, uint64_t value) {
+        uint16_t& baseline = last[channels[i]];
+        baseline += unzigzag(value);
+        baselines[i] = baseline;
+      }
+  );
+}
+
+void decode_lengths(Reader& column, size_t nhits, uint16_t* lengths) {
+  uint16_t last = 0;
+  decode_values(
+      column, nhits,
+      [lengths, &last](size_t i, uint64_t value) {
+        last += unzigzag(value);
+        lengths[i] = last;
+      }
+  );
+}
+
+}; // namespace
+
+void HitCodec::encode(const Hit* hits, size_t nhits, std::vector<uint8_t>& out) {
+  size_t header = out.size();
+  out.resize(header + columns * sizeof(uint32_t));
+  uint32_t sizes[columns];
+
+  // A slice starts far from 0, so the deltas are taken from the first hit
+  // rather than from 0, which would widen the whole first block.
+  size_t start = out.size();
+  if (nhits) {
+    uint64_t last_time = hits[0].time;
+    out.resize(start + varint_size(last_time));
+    put_varint(out.data() + start, last_time);
+    encode_values(
+        out, nhits,
+        [hits, &last_time](size_t i) {
+          uint64_t value = zigzag(hits[i].time - last_time);
+          last_time = hits[i].time;
+          return value;
+        }
+    );
+  };
+  sizes[time] = out.size() - start;
+
+  sizes[charge_short] = encode_values(
+      out, nhits,
+      [hits](size_t i) -> uint64_t { return hits[i].charge_short; }
+  );
+
+  sizes[charge_long] = encode_values(
+      out, nhits,
+      [hits](size_t i) -> uint64_t { return hits[i].charge_long; }
+  );
+
+  uint16_t last_baseline[256] = {};
+  sizes[baseline] = encode_values(
+      out, nhits,
+      [hits, &last_baseline](size_t i) {
+        uint16_t& last = last_baseline[hits[i].channel];
+        uint64_t value = zigzag(int16_t(uint16_t(hits[i].baseline - last)));
+        last = hits[i].baseline;
+        return value;
+      }
+  );
+
+  // channels: packed (mode 0) or runs of (channel, varint length - 1)
+  // (mode 1), whichever is smaller
+  start = out.size();
+  if (nhits) {
+    out.push_back(0);
+    encode_values(
+        out, nhits,
+        [hits](size_t i) -> uint64_t { return hits[i].channel; }
+    );
+    size_t runs = 1;
+    for (size_t i = 0; i < nhits;) {
+      size_t j = i + 1;
+      while (j < nhits && hits[j].channel == hits[i].channel) ++j;
+      runs += 1 + varint_size(j - i - 1);
+      i = j;
+    };
+    if (runs < out.size() - start) {
+      out.resize(start + runs);
+      uint8_t* p = out.data() + start;
+      *p++ = 1;
+      for (size_t i = 0; i < nhits;) {
+        size_t j = i + 1;
+        while (j < nhits && hits[j].channel == hits[i].channel) ++j;
+        *p++ = hits[i].channel;
+        p = put_varint(p, j - i - 1);
+        i = j;
+      };
+    };
+  };
+  sizes[channel] = out.size() - start;
+
+  uint16_t last_length = 0;
+  sizes[waveform_length] = encode_values(
+      out, nhits,
+      [hits, &last_length](size_t i) {
+        uint64_t value = zigzag(
+            int16_t(uint16_t(hits[i].waveform_length - last_length))
+        );
+        last_length = hits[i].waveform_length;
+        return value;
+      }
+  );
+
+  std::memcpy(out.data() + header, sizes, sizeof(sizes));
+}
+
+void HitCodec::decode(
+    const uint8_t* data, size_t size, size_t nhits, Hit* hits
+) {
+  Columns columns(data, size);
+
+  std::vector<uint64_t> times(nhits);
+  decode_times(columns.column[time], nhits, times.data());
+
+  std::vector<uint16_t> values(nhits);
+  decode_charges(columns.column[charge_short], nhits, values.data());
+  for (size_t i = 0; i < nhits; ++i) {
+    hits[i].time         = times[i];
+    hits[i].charge_short = values[i];
+  };
+
+  decode_charges(columns.column[charge_long], nhits, values.data());
+  for (size_t i = 0; i < nhits; ++i) hits[i].charge_long = values[i];
+
+  std::vector<uint8_t> channels(nhits);
+  decode_channels(columns.column[channel], nhits, channels.data());
+  decode_baselines(
+      columns.column[baseline], nhits, channels.data(), values.data()
+  );
+  for (size_t i = 0; i < nhits; ++i) {
+    hits[i].channel  = channels[i];
+    hits[i].baseline = values[i];
+  };
+
+  decode_lengths(columns.column[waveform_length], nhits, values.data());
+  uint32_t offset = 0;
+  for (size_t i = 0; i < nhits; ++i) {
+    hits[i].waveform_length = values[i];
+    hits[i].waveform_offset = offset;
+    offset += values[i];
+  };
+}
+
+void HitCodec::decode_time(
+    const uint8_t* data, size_t size, size_t nhits, uint64_t* times
+) {
+  Columns columns(data, size);
+  decode_times(columns.column[time], nhits, times);
+}
+
+void HitCodec::decode_channel(
+    const uint8_t* data, size_t size, size_t nhits, uint8_t* channels
+) {
+  Columns columns(data, size);
+  decode_channels(columns.column[channel], nhits, channels);
+}
+
+void HitCodec::decode_column(
+    const uint8_t* data,
+    size_t         size,
+    size_t         nhits,
+    Column         column,
+    uint16_t*      values
+) {
+  Columns columns(data, size);
+  switch (column) {
+    case charge_short:
+    case charge_long:
+      decode_charges(columns.column[column], nhits, values);
+      break;
+    case baseline:
+      {
+        std::vector<uint8_t> channels(nhits);
+        decode_channels(columns.column[channel], nhits, channels.data());
+        decode_baselines(columns.column[baseline], nhits, channels.data(), values);
+      };
+      break;
+    case waveform_length:
+      decode_lengths(columns.column[waveform_length], nhits, values);
+      break;
+    default:
+      throw std::invalid_argument("HitCodec: not a 16 bit column");
+  };
+}
@@ -0,0 +1,68 @@
+#ifndef HIT_CODEC_H
+#define HIT_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Hit.h"
+
+// Lossless compression of the hit columns for storage. The hits are
+// expected in time order (as they leave the Sorter), so that the stored
+// values are small. Each column is transformed as follows, and the values
+// are bit-packed in blocks of 128 with the width of the largest value in the
+// block (see BitPack.h):
+//   time:            the time of the first hit as a varint, then the
+//                    difference from the previous hit, zigzag encoded (0
+//                    for the first hit)
+//   charge_short,
+//   charge_long:     as is
+//   baseline:        difference from the previous hit of the same channel,
+//                    zigzag encoded
+//   channel:         as is, or runs of (channel byte, varint run length - 1)
+//                    if smaller; the column starts with 0 or 1 respectively
+//   waveform_length: difference from the previous hit, zigzag encoded
+//
+// Encoded hits: uint32_t size of each column in bytes, in the order of
+// HitCodec::Column, followed by the columns. Each column can be decoded on
+// its own, except baseline which needs the channels.
+//
+// Hit::waveform_offset is not stored: decoded hits get the offsets of the
+// waveforms stored in the order of the hits.
+class HitCodec {
+  public:
+    enum Column {
+      time,
+      charge_short,
+      charge_long,
+      baseline,
+      channel,
+      waveform_length,
+      columns // number of columns
+    };
+
+    // Appends the encoded hits to `out`
+    static void encode(const Hit* hits, size_t nhits, std::vector<uint8_t>& out);
+
+    // Decodes `nhits` hits from `size` bytes at `data`. Throws
+    // std::runtime_error on malformed data.
+    static void decode(const uint8_t* data, size_t size, size_t nhits, Hit* hits);
+
+    // Decode a single column
+    static void decode_time(
+        const uint8_t* data, size_t size, size_t nhits, uint64_t* times
+    );
+    static void decode_channel(
+        const uint8_t* data, size_t size, size_t nhits, uint8_t* channels
+    );
+    // charge_short, charge_long, baseline or waveform_length
+    static void decode_column(
+        const uint8_t* data,
+        size_t         size,
+        size_t         nhits,
+        Column         column,
+        uint16_t*      values
+    );
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Thread safe free list of objects. Objects returned with `put` keep their
+// allocated memory (e.g., vector capacity) and are handed out again by `get`,
+// so that steady data flow does not go through the allocator. The caller is
+// responsible for clearing the objects before returning them.
+template <typename T>
+class Pool {
+  public:
+    // maximal number of objects kept in the free list; excess objects are
+    // deleted
+    size_t capacity = 1024;
+
+    std::unique_ptr<T> get() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free.empty()) {
+          std::unique_ptr<T> object = std::move(free.back());
+          free.pop_back();
+          return object;
+        };
+      };
+      return std::unique_ptr<T>(new T());
+    };
+
+    void put(std::unique_ptr<T> object) {
+      if (!object) return;
+      std::lock_guard<std::mutex> lock(mutex);
+      if (free.size() < capacity) free.push_back(std::move(object));
+    };
+
+  private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<T>> free;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include <stdexcept>
+
+#include "QueueLimit.h"
+
+QueueLimit::Policy QueueLimit::parse_policy(const std::string& policy) {
+  if (policy == "block") return Policy::block;
+  if (policy == "drop")  return Policy::drop;
+  if (policy == "spill") return Policy::spill;
+  throw std::runtime_error("QueueLimit: unknown policy: " + policy);
+}
+
+void QueueLimit::discard(const HitBlock& block) {
+  if (policy == Policy::spill) {
+    std::lock_guard<std::mutex> lock(spill_mutex);
+    if (!spill.is_open()) {
+      spill.open(spill_path, std::ios::binary | std::ios::app);
+      if (!spill)
+        throw std::runtime_error(
+            "QueueLimit: failed to open spill file " + spill_path
+        );
+    };
+    uint64_t nhits    = block.hits.size();
+    uint64_t nsamples = block.waveforms.size();
+    spill.write(reinterpret_cast<const char*>(&nhits),    sizeof(nhits));
+    spill.write(reinterpret_cast<const char*>(&nsamples), sizeof(nsamples));
+    spill.write(
+        reinterpret_cast<const char*>(block.hits.data()),
+        nhits * sizeof(Hit)
+    );
+    spill.write(
+        reinterpret_cast<const char*>(block.waveforms.data()),
+        nsamples * sizeof(uint16_t)
+    );
+    if (spill) {
+      spilled_hits += nhits;
+      ++spilled_blocks;
+      return;
+    };
+    // disk full or similar; fall back to dropping
+    spill.clear();
+  };
+
+  dropped_hits += block.hits.size();
+  ++dropped_blocks;
+}
+
+void QueueLimit::report(
+    ToolFramework::Store& data, const std::string& prefix
+) const {
+  data.Set(prefix + "_hits",           hits.load());
+  data.Set(prefix + "_bytes",          bytes.load());
+  data.Set(prefix + "_dropped_hits",   dropped_hits.load());
+  data.Set(prefix + "_dropped_blocks", dropped_blocks.load());
+  data.Set(prefix + "_spilled_hits",   spilled_hits.load());
+  data.Set(prefix + "_spilled_blocks", spilled_blocks.load());
+}
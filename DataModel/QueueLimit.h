@@ -0,0 +1,82 @@
+#ifndef QUEUE_LIMIT_H
+#define QUEUE_LIMIT_H
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include "Store.h"
+
+#include "Hit.h"
+
+// Occupancy of a queue of hits between tools, its high watermarks and the
+// policy applied by the producer when they are reached. The producer calls
+// `add` before queueing a block, the consumer calls `remove` when it is done
+// with the block (so that the hits held by the consumer count too).
+//
+// Policies:
+//   block: the producer waits until the consumer catches up
+//   drop:  the block is discarded and counted
+//   spill: the block is appended to `spill_path` and counted
+class QueueLimit {
+  public:
+    enum class Policy { block, drop, spill };
+
+    // Parses "block", "drop" or "spill". Throws std::runtime_error otherwise.
+    static Policy parse_policy(const std::string& policy);
+
+    // high watermarks; 0 means no limit
+    size_t max_hits  = 0;
+    size_t max_bytes = 0;
+
+    Policy policy = Policy::block;
+
+    // Spill file. Blocks are written as the number of hits (uint64_t), the
+    // number of waveform samples (uint64_t), the hits and the samples.
+    std::string spill_path;
+
+    // current occupancy
+    std::atomic<size_t> hits  {0};
+    std::atomic<size_t> bytes {0};
+
+    std::atomic<uint64_t> dropped_hits    {0};
+    std::atomic<uint64_t> dropped_blocks  {0};
+    std::atomic<uint64_t> spilled_hits    {0};
+    std::atomic<uint64_t> spilled_blocks  {0};
+
+    // memory taken by the block payload
+    static size_t size(const HitBlock& block) {
+      return block.hits.size()      * sizeof(Hit)
+           + block.waveforms.size() * sizeof(uint16_t);
+    };
+
+    bool full() const {
+      return (max_hits  && hits.load()  >= max_hits)
+          || (max_bytes && bytes.load() >= max_bytes);
+    };
+
+    void add(const HitBlock& block) {
+      hits  += block.hits.size();
+      bytes += size(block);
+    };
+
+    void remove(const HitBlock& block) {
+      hits  -= block.hits.size();
+      bytes -= size(block);
+    };
+
+    // Disposes of a block that does not fit according to the drop or spill
+    // policy. The block is left intact. Thread safe.
+    void discard(const HitBlock& block);
+
+    // Reports the occupancy and the counters as <prefix>_<name>
+    void report(ToolFramework::Store& data, const std::string& prefix) const;
+
+  private:
+    std::mutex    spill_mutex;
+    std::ofstream spill;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef RAW_READOUT_H
+#define RAW_READOUT_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include "Hit.h"
+#include "SPSCQueue.h"
+
+// Hand-off of hit blocks from the readout threads (producers) to the
+// Reformatter (consumer). Each producer thread gets its own bounded
+// single-producer single-consumer queue, so that neither side takes a lock
+// per block. Queues are only added, never removed, so that the consumer can
+// iterate over them while new producers register.
+class RawReadout {
+  public:
+    typedef SPSCQueue<std::unique_ptr<HitBlock>> Queue;
+
+    static const size_t max_queues = 64;
+
+    RawReadout(): count(0) {};
+
+    // Create a queue for a new producer. Thread safe.
+    Queue* add(size_t capacity) {
+      std::lock_guard<std::mutex> lock(mutex);
+      size_t n = count.load(std::memory_order_relaxed);
+      if (n == max_queues)
+        throw std::runtime_error("RawReadout: too many producers");
+      queues[n].reset(new Queue(capacity));
+      count.store(n + 1, std::memory_order_release);
+      return queues[n].get();
+    };
+
+    // number of queues
+    size_t size() const { return count.load(std::memory_order_acquire); };
+
+    Queue& operator[](size_t i) { return *queues[i]; };
+
+  private:
+    std::mutex mutex;
+    std::unique_ptr<Queue> queues[max_queues];
+    std::atomic<size_t> count;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. The capacity is rounded up to a power of two.
+template <typename T>
+class SPSCQueue {
+  public:
+    explicit SPSCQueue(size_t capacity): head(0), tail(0) {
+      size_t size = 1;
+      while (size < capacity) size <<= 1;
+      buffer.resize(size);
+      mask = size - 1;
+      head_cache = tail_cache = 0;
+    };
+
+    // Producer. Moves `value` into the queue and returns true if there is
+    // space; leaves `value` intact and returns false otherwise.
+    bool push(T& value) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      if (t - head_cache > mask) {
+        head_cache = head.load(std::memory_order_acquire);
+        if (t - head_cache > mask) return false;
+      };
+      buffer[t & mask] = std::move(value);
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+    };
+
+    // Consumer. Moves the front element into `value` and returns true if the
+    // queue is not empty.
+    bool pop(T& value) {
+      size_t h = head.load(std::memory_order_relaxed);
+      if (h == tail_cache) {
+        tail_cache = tail.load(std::memory_order_acquire);
+        if (h == tail_cache) return false;
+      };
+      value = std::move(buffer[h & mask]);
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    };
+
+    // Number of elements in the queue. Exact only when called from the
+    // producer or the consumer thread while the other one is idle.
+    size_t size() const {
+      return tail.load(std::memory_order_acquire)
+           - head.load(std::memory_order_acquire);
+    };
+
+    size_t capacity() const { return mask + 1; };
+
+  private:
+    std::vector<T> buffer;
+    size_t mask;
+
+    // head and tail are kept on separate cache lines together with the other
+    // side's cached copy of them. Padding rather than alignas: over-aligned
+    // operator new is not available in C++11.
+    char                pad0[64];
+    std::atomic<size_t> head;       // written by the consumer
+    size_t              tail_cache; // consumer's copy of tail
+    char                pad1[64];
+    std::atomic<size_t> tail;       // written by the producer
+    size_t              head_cache; // producer's copy of head
+    char                pad2[64];
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef SLICE_FILE_H
+#define SLICE_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Layout of the data files written by the DataWriter. All values are in the
+// byte order of the writing machine (little endian).
+//
+// file:  FileHeader, slices, index, FileTrailer
+// slice: SliceHeader followed by the columns, each starting at a multiple of
+//        8 bytes from the slice start (see SliceLayout):
+//          hit columns, nhits values each:
+//            time (uint64_t), charge_short, charge_long, baseline (uint16_t),
+//            channel (uint8_t), waveform_length (uint16_t)
+//            or, with the hit_codec flag, hits_size bytes of hits encoded by
+//            HitCodec
+//          waveforms: nsamples uint16_t, the waveforms in the order of the
+//            hits, or, with the waveform_codec flag, waveforms_size bytes
+//            encoded by WaveformCodec
+//          trigger columns, ntriggers values each:
+//            trigger_time (uint64_t), trigger_type (uint8_t)
+//          event columns, nevents values each:
+//            event_start, event_end (uint64_t), event_first_hit,
+//            event_nhits (uint32_t), event_triggers (uint8_t)
+// index: IndexEntry per slice, in the order of the slices
+//
+// A reader finds the index from the trailer at the end of the file, and the
+// columns of a slice from its header (see SliceReader.h).
+namespace slice_file {
+
+static const char     magic[8] = { 'B', 'U', 'T', 'T', 'O', 'N', 'D', 'Q' };
+// incremented on every change of the layout, including the codecs
+static const uint32_t version  = 3;
+
+// FileHeader::flags
+enum : uint32_t {
+  hit_codec      = 1, // hit columns are compressed with HitCodec
+  waveform_codec = 2  // waveforms are compressed with WaveformCodec
+};
+
+struct FileHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t flags;
+};
+
+struct SliceHeader {
+  uint64_t size; // of the slice including the header, bytes
+  uint64_t nhits;
+  uint64_t nsamples;
+  uint64_t ntriggers;
+  uint64_t nevents;
+  uint64_t first_time; // of the first and the last hit, in units of Hit::time
+  uint64_t last_time;
+  uint64_t hits_size;      // of the hit columns, bytes
+  uint64_t waveforms_size; // of the waveforms, bytes
+};
+
+struct IndexEntry {
+  uint64_t offset; // of the SliceHeader from the file start
+  uint64_t nhits;
+  uint64_t first_time;
+  uint64_t last_time;
+};
+
+struct FileTrailer {
+  uint64_t index_offset; // from the file start
+  uint64_t nslices;
+  char     magic[8];
+};
+
+inline void init(FileHeader& header, uint32_t flags) {
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.flags   = flags;
+}
+
+inline void init(FileTrailer& trailer, uint64_t index_offset, uint64_t nslices) {
+  trailer.index_offset = index_offset;
+  trailer.nslices      = nslices;
+  std::memcpy(trailer.magic, magic, sizeof(magic));
+}
+
+// Column offsets in a slice, bytes from the start of the SliceHeader. With
+// the hit_codec flag, the encoded hits start at `hits`, and the offsets of
+// the individual hit columns are 0.
+struct SliceLayout {
+  size_t hits;
+  size_t time;
+  size_t charge_short;
+  size_t charge_long;
+  size_t baseline;
+  size_t channel;
+  size_t waveform_length;
+  size_t waveforms;
+  size_t trigger_time;
+  size_t trigger_type;
+  size_t event_start;
+  size_t event_end;
+  size_t event_first_hit;
+  size_t event_nhits;
+  size_t event_triggers;
+  size_t size;
+
+  SliceLayout(const SliceHeader& header, uint32_t flags) {
+    size_t offset = sizeof(SliceHeader);
+    auto column = [&offset](size_t size) -> size_t {
+      size_t start = offset;
+      offset += (size + 7) & ~size_t(7);
+      return start;
+    };
+    hits = offset;
+    if (flags & hit_codec) {
+      column(header.hits_size);
+      time = charge_short = charge_long = baseline = channel
+           = waveform_length = 0;
+    } else {
+      time            = column(header.nhits * sizeof(uint64_t));
+      charge_short    = column(header.nhits * sizeof(uint16_t));
+      charge_long     = column(header.nhits * sizeof(uint16_t));
+      baseline        = column(header.nhits * sizeof(uint16_t));
+      channel         = column(header.nhits * sizeof(uint8_t));
+      waveform_length = column(header.nhits * sizeof(uint16_t));
+    };
+    waveforms       = column(
+        flags & waveform_codec
+        ? header.waveforms_size
+        : header.nsamples * sizeof(uint16_t)
+    );
+    trigger_time    = column(header.ntriggers * sizeof(uint64_t));
+    trigger_type    = column(header.ntriggers * sizeof(uint8_t));
+    event_start     = column(header.nevents   * sizeof(uint64_t));
+    event_end       = column(header.nevents   * sizeof(uint64_t));
+    event_first_hit = column(header.nevents   * sizeof(uint32_t));
+    event_nhits     = column(header.nevents   * sizeof(uint32_t));
+    event_triggers  = column(header.nevents   * sizeof(uint8_t));
+    size            = offset;
+  };
+};
+
+}; // namespace slice_file
+
+#endif
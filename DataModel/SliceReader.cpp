@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "HitCodec.h"
+#include "SliceReader.h"
+#include "WaveformCodec.h"
+
+using namespace slice_file;
+
+namespace {
+
+// Returns the header of the slice at `data` after checking that it fits in
+// `size` bytes. The counts are checked before the layout is computed from
+// them, so that the computation cannot overflow.
+const SliceHeader* slice_header(const char* data, size_t size) {
+  const SliceHeader* header = reinterpret_cast<const SliceHeader*>(data);
+  if (size < sizeof(SliceHeader) || header->size > size
+      || header->nhits > size || header->nsamples > size
+      || header->ntriggers > size || header->nevents > size
+      || header->hits_size > size || header->waveforms_size > size)
+    throw std::runtime_error("SliceReader: truncated slice");
+  return header;
+}
+
+}; // namespace
+
+SliceView::SliceView(const char* data, size_t size, uint32_t flags):
+  data(data),
+  flags(flags),
+  header_(slice_header(data, size)),
+  layout(*header_, flags)
+{
+  if (layout.size != header_->size)
+    throw std::runtime_error("SliceReader: truncated slice");
+}
+
+ColumnView<uint16_t> SliceView::hit_column(
+    size_t offset, int column, std::vector<uint16_t>& decoded
+) {
+  if (!(flags & hit_codec)) return raw<uint16_t>(offset, header_->nhits);
+  if (decoded.size() != header_->nhits) {
+    decoded.resize(header_->nhits);
+    HitCodec::decode_column(
+        reinterpret_cast<const uint8_t*>(data + layout.hits),
+        header_->hits_size,
+        header_->nhits,
+        static_cast<HitCodec::Column>(column),
+        decoded.data()
+    );
+  };
+  return ColumnView<uint16_t>(decoded.data(), decoded.size());
+}
+
+ColumnView<uint64_t> SliceView::time() {
+  if (!(flags & hit_codec)) return raw<uint64_t>(layout.time, header_->nhits);
+  if (time_.size() != header_->nhits) {
+    time_.resize(header_->nhits);
+    HitCodec::decode_time(
+        reinterpret_cast<const uint8_t*>(data + layout.hits),
+        header_->hits_size,
+        header_->nhits,
+        time_.data()
+    );
+  };
+  return ColumnView<uint64_t>(time_.data(), time_.size());
+}
+
+ColumnView<uint16_t> SliceView::charge_short() {
+  return hit_column(layout.charge_short, HitCodec::charge_short, charge_short_);
+}
+
+ColumnView<uint16_t> SliceView::charge_long() {
+  return hit_column(layout.charge_long, HitCodec::charge_long, charge_long_);
+}
+
+ColumnView<uint16_t> SliceView::baseline() {
+  return hit_column(layout.baseline, HitCodec::baseline, baseline_);
+}
+
+ColumnView<uint8_t> SliceView::channel() {
+  if (!(flags & hit_codec)) return raw<uint8_t>(layout.channel, header_->nhits);
+  if (channel_.size() != header_->nhits) {
+    channel_.resize(header_->nhits);
+    HitCodec::decode_channel(
+        reinterpret_cast<const uint8_t*>(data + layout.hits),
+        header_->hits_size,
+        header_->nhits,
+        channel_.data()
+    );
+  };
+  return ColumnView<uint8_t>(channel_.data(), channel_.size());
+}
+
+ColumnView<uint16_t> SliceView::waveform_length() {
+  return hit_column(
+      layout.waveform_length, HitCodec::waveform_length, waveform_length_
+  );
+}
+
+ColumnView<uint16_t> SliceView::waveforms() {
+  if (!(flags & waveform_codec))
+    return raw<uint16_t>(layout.waveforms, header_->nsamples);
+  if (waveforms_.size() != header_->nsamples) {
+    waveforms_.resize(header_->nsamples);
+    WaveformCodec::decode(
+        reinterpret_cast<const uint8_t*>(data + layout.waveforms),
+        header_->waveforms_size,
+        header_->nsamples,
+        waveforms_.data()
+    );
+  };
+  return ColumnView<uint16_t>(waveforms_.data(), waveforms_.size());
+}
+
+ColumnView<uint16_t> SliceView::waveform(size_t hit) {
+  if (waveform_offsets.size() != header_->nhits + 1) {
+    ColumnView<uint16_t> lengths = waveform_length();
+    waveform_offsets.resize(header_->nhits + 1);
+    waveform_offsets[0] = 0;
+    for (size_t i = 0; i < lengths.size; ++i)
+      waveform_offsets[i + 1] = waveform_offsets[i] + lengths[i];
+    if (waveform_offsets.back() > header_->nsamples)
+      throw std::runtime_error("SliceReader: waveform lengths exceed samples");
+  };
+  ColumnView<uint16_t> samples = waveforms();
+  return ColumnView<uint16_t>(
+      samples.data + waveform_offsets[hit],
+      waveform_offsets[hit + 1] - waveform_offsets[hit]
+  );
+}
+
+ColumnView<uint64_t> SliceView::trigger_time() {
+  return raw<uint64_t>(layout.trigger_time, header_->ntriggers);
+}
+
+ColumnView<uint8_t> SliceView::trigger_type() {
+  return raw<uint8_t>(layout.trigger_type, header_->ntriggers);
+}
+
+ColumnView<uint64_t> SliceView::event_start() {
+  return raw<uint64_t>(layout.event_start, header_->nevents);
+}
+
+ColumnView<uint64_t> SliceView::event_end() {
+  return raw<uint64_t>(layout.event_end, header_->nevents);
+}
+
+ColumnView<uint32_t> SliceView::event_first_hit() {
+  return raw<uint32_t>(layout.event_first_hit, header_->nevents);
+}
+
+ColumnView<uint32_t> SliceView::event_nhits() {
+  return raw<uint32_t>(layout.event_nhits, header_->nevents);
+}
+
+ColumnView<uint8_t> SliceView::event_triggers() {
+  return raw<uint8_t>(layout.event_triggers, header_->nevents);
+}
+
+std::pair<size_t, size_t> SliceView::hits_between(uint64_t start, uint64_t end) {
+  ColumnView<uint64_t> times = time();
+  const uint64_t* first = std::lower_bound(times.begin(), times.end(), start);
+  const uint64_t* last  = std::lower_bound(first, times.end(), end);
+  return std::make_pair(first - times.begin(), last - times.begin());
+}
+
+void SliceView::select(
+    uint64_t               start,
+    uint64_t               end,
+    const ChannelMask&     channels,
+    std::vector<uint32_t>& hits
+) {
+  std::pair<size_t, size_t> range = hits_between(start, end);
+  if (range.first == range.second) return;
+  ColumnView<uint8_t> channel = this->channel();
+  for (size_t i = range.first; i < range.second; ++i)
+    if (channels.test(channel[i])) hits.push_back(i);
+}
+
+SliceReader::SliceReader(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error(
+        "SliceReader: failed to open " + path + ": " + std::strerror(errno)
+    );
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int error = errno;
+    ::close(fd);
+    throw std::runtime_error(
+        "SliceReader: failed to stat " + path + ": " + std::strerror(error)
+    );
+  };
+  size_ = st.st_size;
+  if (size_ < sizeof(FileHeader) + sizeof(FileTrailer)) {
+    ::close(fd);
+    throw std::runtime_error("SliceReader: " + path + " is not a data file");
+  };
+
+  void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  int error = errno;
+  ::close(fd);
+  if (map == MAP_FAILED)
+    throw std::runtime_error(
+        "SliceReader: failed to map " + path + ": " + std::strerror(error)
+    );
+  data = static_cast<const char*>(map);
+
+  try {
+    header = reinterpret_cast<const FileHeader*>(data);
+    if (std::memcmp(header->magic, magic, sizeof(magic)) != 0)
+      throw std::runtime_error("SliceReader: " + path + " is not a data file");
+    if (header->version != version)
+      throw std::runtime_error(
+          "SliceReader: " + path + " has unsupported version "
+          + std::to_string(header->version)
+      );
+
+    const FileTrailer* trailer = reinterpret_cast<const FileTrailer*>(
+        data + size_ - sizeof(FileTrailer)
+    );
+    if (std::memcmp(trailer->magic, magic, sizeof(magic)) != 0)
+      throw std::runtime_error(
+          "SliceReader: " + path + " is incomplete (no trailer)"
+      );
+    size_t index_end = size_ - sizeof(FileTrailer);
+    if (trailer->index_offset < sizeof(FileHeader)
+        || trailer->index_offset > index_end
+        || trailer->nslices
+           > (index_end - trailer->index_offset) / sizeof(IndexEntry)
+        || (trailer->nslices
+            && trailer->index_offset
+               < sizeof(FileHeader) + sizeof(SliceHeader)))
+      throw std::runtime_error("SliceReader: " + path + " has a corrupt index");
+    index   = reinterpret_cast<const IndexEntry*>(data + trailer->index_offset);
+    nslices = trailer->nslices;
+    // the offsets are bounded by the file size, so the sums cannot overflow
+    for (size_t i = 0; i < nslices; ++i)
+      if (index[i].offset < sizeof(FileHeader)
+          || index[i].offset > size_
+          || index[i].offset + sizeof(SliceHeader) > trailer->index_offset)
+        throw std::runtime_error(
+            "SliceReader: " + path + " has a corrupt index"
+        );
+
+    // Slices are written in the order they leave the triggers, which is not
+    // strictly the time order. Sorting by first_time and keeping the running
+    // maximum of last_time lets find() skip the slices ending before the
+    // range with a binary search.
+    by_time.reserve(nslices);
+    for (size_t i = 0; i < nslices; ++i)
+      if (index[i].nhits) by_time.push_back(i);
+    std::sort(
+        by_time.begin(), by_time.end(),
+        [this](size_t a, size_t b) {
+          return index[a].first_time < index[b].first_time;
+        }
+    );
+    max_last_time.resize(by_time.size());
+    uint64_t last = 0;
+    for (size_t i = 0; i < by_time.size(); ++i) {
+      last = std::max(last, index[by_time[i]].last_time);
+      max_last_time[i] = last;
+    };
+  } catch (...) {
+    munmap(const_cast<char*>(data), size_);
+    throw;
+  };
+
+  madvise(const_cast<char*>(data), size_, MADV_RANDOM);
+}
+
+SliceReader::~SliceReader() {
+  munmap(const_cast<char*>(data), size_);
+}
+
+SliceView SliceReader::slice(size_t slice) const {
+  // slices end where the index starts
+  size_t offset = index[slice].offset;
+  size_t end    = reinterpret_cast<const char*>(index) - data;
+  return SliceView(data + offset, end - offset, header->flags);
+}
+
+std::vector<size_t> SliceReader::find(uint64_t start, uint64_t end) const {
+  std::vector<size_t> result;
+  if (start >= end) return result;
+  // first slice in by_time which may end at or after start
+  size_t first = std::lower_bound(
+      max_last_time.begin(), max_last_time.end(), start
+  ) - max_last_time.begin();
+  for (size_t i = first; i < by_time.size(); ++i) {
+    const IndexEntry& entry = index[by_time[i]];
+    if (entry.first_time >= end) break;
+    if (entry.last_time >= start) result.push_back(by_time[i]);
+  };
+  return result;
+}
+
+std::vector<std::string> SliceReader::find_files(
+    const std::string& catalog, uint64_t start, uint64_t end
+) {
+  std::ifstream file(catalog);
+  if (!file)
+    throw std::runtime_error("SliceReader: failed to open " + catalog);
+
+  std::vector<std::string> result;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream ss(line);
+    std::string path;
+    uint64_t first, last, nslices, nhits;
+    if (!(ss >> path >> first >> last >> nslices >> nhits))
+      throw std::runtime_error(
+          "SliceReader: malformed line in " + catalog + ": " + line
+      );
+    if (nhits && first < end && last >= start) result.push_back(path);
+  };
+  return result;
+}
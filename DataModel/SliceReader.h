@@ -0,0 +1,147 @@
+#ifndef SLICE_READER_H
+#define SLICE_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ChannelMask.h"
+#include "SliceFile.h"
+
+// Read-only array of values of a column
+template <typename T>
+struct ColumnView {
+  const T* data;
+  size_t   size;
+
+  ColumnView(): data(nullptr), size(0) {};
+  ColumnView(const T* data, size_t size): data(data), size(size) {};
+
+  const T* begin() const { return data; };
+  const T* end()   const { return data + size; };
+  const T& operator[](size_t i) const { return data[i]; };
+  bool empty() const { return size == 0; };
+};
+
+// Slice of a data file (see SliceReader). Uncompressed columns are views of
+// the mapped file; compressed columns are decoded on first access and kept
+// in the SliceView. The views are valid while both the SliceView and the
+// SliceReader exist.
+class SliceView {
+  public:
+    // Throws std::runtime_error if the slice does not fit in `size` bytes
+    SliceView(const char* data, size_t size, uint32_t flags);
+
+    const slice_file::SliceHeader& header() const { return *header_; };
+    size_t nhits() const { return header_->nhits; };
+
+    ColumnView<uint64_t> time();
+    ColumnView<uint16_t> charge_short();
+    ColumnView<uint16_t> charge_long();
+    ColumnView<uint16_t> baseline();
+    ColumnView<uint8_t>  channel();
+    ColumnView<uint16_t> waveform_length();
+
+    // Samples of all waveforms, in the order of the hits
+    ColumnView<uint16_t> waveforms();
+    // Samples of the waveform of the hit
+    ColumnView<uint16_t> waveform(size_t hit);
+
+    ColumnView<uint64_t> trigger_time();
+    ColumnView<uint8_t>  trigger_type();
+
+    ColumnView<uint64_t> event_start();
+    ColumnView<uint64_t> event_end();
+    ColumnView<uint32_t> event_first_hit();
+    ColumnView<uint32_t> event_nhits();
+    ColumnView<uint8_t>  event_triggers();
+
+    // Range [first, last) of the hits with time in [start, end) (the hits
+    // are in time order)
+    std::pair<size_t, size_t> hits_between(uint64_t start, uint64_t end);
+
+    // Appends to `hits` the indices of the hits with time in [start, end)
+    // on the `channels`
+    void select(
+        uint64_t               start,
+        uint64_t               end,
+        const ChannelMask&     channels,
+        std::vector<uint32_t>& hits
+    );
+
+  private:
+    const char* data;
+    uint32_t    flags;
+    const slice_file::SliceHeader* header_;
+    slice_file::SliceLayout layout;
+
+    // decoded columns
+    std::vector<uint64_t> time_;
+    std::vector<uint16_t> charge_short_;
+    std::vector<uint16_t> charge_long_;
+    std::vector<uint16_t> baseline_;
+    std::vector<uint8_t>  channel_;
+    std::vector<uint16_t> waveform_length_;
+    std::vector<uint16_t> waveforms_;
+    // index of the first sample of each waveform
+    std::vector<uint64_t> waveform_offsets;
+
+    template <typename T>
+    ColumnView<T> raw(size_t offset, size_t size) const {
+      return ColumnView<T>(reinterpret_cast<const T*>(data + offset), size);
+    };
+
+    ColumnView<uint16_t> hit_column(
+        size_t offset, int column, std::vector<uint16_t>& decoded
+    );
+};
+
+// Memory-mapped data file written by the DataWriter (see SliceFile.h). The
+// slice index at the end of the file gives the slices overlapping a time
+// range without reading the rest of the file.
+class SliceReader {
+  public:
+    // Throws std::runtime_error if the file cannot be mapped or is not a
+    // complete data file
+    explicit SliceReader(const std::string& path);
+    ~SliceReader();
+
+    SliceReader(const SliceReader&) = delete;
+    SliceReader& operator=(const SliceReader&) = delete;
+
+    uint32_t flags() const { return header->flags; };
+
+    // Number of slices
+    size_t size() const { return nslices; };
+
+    const slice_file::IndexEntry& entry(size_t slice) const {
+      return index[slice];
+    };
+
+    SliceView slice(size_t slice) const;
+
+    // Slices with hits in [start, end) (in units of Hit::time), in time order
+    std::vector<size_t> find(uint64_t start, uint64_t end) const;
+
+    // Files in the catalog written by the DataWriter with hits in
+    // [start, end)
+    static std::vector<std::string> find_files(
+        const std::string& catalog, uint64_t start, uint64_t end
+    );
+
+  private:
+    const char* data = nullptr;
+    size_t      size_ = 0;
+
+    const slice_file::FileHeader* header;
+    const slice_file::IndexEntry* index;
+    size_t nslices;
+
+    // non-empty slices by first_time, with the running maximum of last_time
+    std::vector<size_t>   by_time;
+    std::vector<uint64_t> max_last_time;
+};
+
+#endif
@@ -1,22 +1,107 @@
 #ifndef TIME_SLICE_H
 #define TIME_SLICE_H
 
+#include <atomic>
+#include <bitset>
 #include <vector>
-#include <map>
-#include <mutex>
-#include <type_traits>
 
 #include <cstddef>
+#include <cstdint>
 
 #include "Hit.h"
 
-enum class trigger_type {nhits, calib, zero_bais};  
+enum class trigger_type {nhits, calib, zero_bais};
+static const size_t trigger_types = 3; // number of trigger_type values
 
-struct TimeSlice {
-  std::vector<Hit> hits;
-  std::mutex mutex;
-  std::vector<std::pair<trigger_type, unsigned long>> positive_trggers;
-  std::map<trigger_type, bool> trigger_flags;
+struct TriggerRecord {
+  uint64_t     time; // in units of Hit::time
+  trigger_type type;
+};
+
+// Event built around one or more overlapping trigger windows
+struct Event {
+  uint64_t start; // window [start, end) in units of Hit::time
+  uint64_t end;
+  uint32_t first_hit; // index in HitBlock::hits
+  uint32_t nhits;
+  uint8_t  triggers; // bit mask of the trigger types
+};
+
+// Hits and their waveforms are in HitBlock::hits and HitBlock::waveforms
+//
+// Trigger bookkeeping: the Sorter sets `triggers` and `pending`. Each trigger
+// appends its trigger times to its own lane, so that the triggers running
+// concurrently on the timeslice need no lock. The trigger which brings
+// `pending` to zero merges the lanes into `positive_trggers` and passes the
+// timeslice to the EventBuilder (see DataModel::trigger_done).
+struct TimeSlice : HitBlock {
+  // triggers processing the timeslice, indexed by trigger_type
+  std::bitset<trigger_types> triggers;
+  // number of triggers yet to process the timeslice
+  std::atomic<unsigned> pending;
+
+  // trigger times, one lane per trigger_type
+  std::vector<uint64_t> lanes[trigger_types];
+
+  // all triggers in time order, filled when all triggers are done
+  std::vector<TriggerRecord> positive_trggers;
+
+  // Events, filled by the EventBuilder. After event building the timeslice
+  // only holds the hits of the events.
+  std::vector<Event> events;
+
+  TimeSlice(): pending(0) {
+    for (auto& lane : lanes) lane.reserve(64);
+    positive_trggers.reserve(64);
+  };
+
+  TimeSlice(TimeSlice&& timeslice):
+    HitBlock(std::move(timeslice)),
+    triggers(timeslice.triggers),
+    pending(timeslice.pending.load()),
+    positive_trggers(std::move(timeslice.positive_trggers)),
+    events(std::move(timeslice.events))
+  {
+    for (size_t i = 0; i < trigger_types; ++i)
+      lanes[i] = std::move(timeslice.lanes[i]);
+  };
+
+  std::vector<uint64_t>& lane(trigger_type type) {
+    return lanes[static_cast<size_t>(type)];
+  };
+
+  // Merge the lanes (each in time order) into positive_trggers
+  void merge_triggers() {
+    positive_trggers.clear();
+    size_t next[trigger_types] = {};
+    while (true) {
+      size_t best = trigger_types;
+      for (size_t i = 0; i < trigger_types; ++i)
+        if (
+            next[i] < lanes[i].size()
+            && (
+              best == trigger_types
+              || lanes[i][next[i]] < lanes[best][next[best]]
+            )
+        )
+          best = i;
+      if (best == trigger_types) break;
+      TriggerRecord record;
+      record.time = lanes[best][next[best]++];
+      record.type = static_cast<trigger_type>(best);
+      positive_trggers.push_back(record);
+    };
+  };
+
+  // Prepare the timeslice for reuse (see DataModel::timeslices)
+  void clear() {
+    HitBlock::clear();
+    triggers.reset();
+    pending = 0;
+    for (auto& lane : lanes) lane.clear();
+    positive_trggers.clear();
+    events.clear();
+  };
 };
 
 #endif
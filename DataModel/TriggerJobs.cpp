@@ -0,0 +1,60 @@
+#include <algorithm>
+
+#include "DataModel.h"
+#include "TriggerJobs.h"
+
+TriggerJobs::TriggerJobs(
+    DataModel&   data,
+    trigger_type type,
+    Process      process,
+    unsigned     max_jobs,
+    bool         urgent
+):
+  data(data),
+  type(type),
+  process(std::move(process)),
+  max_jobs(std::max(max_jobs, 1u)),
+  urgent(urgent)
+{}
+
+bool TriggerJobs::dispatch(std::chrono::milliseconds timeout) {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!cv.wait_for(lock, timeout, [this]() { return running < max_jobs; }))
+      return false;
+  };
+
+  TimeSlice* timeslice = data.take_timeslice(type, timeout);
+  if (!timeslice) return false;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++running;
+  };
+  data.executor.submit(
+      [this, timeslice]() { run(timeslice); }, &stats, urgent
+  );
+  return true;
+}
+
+void TriggerJobs::run(TimeSlice* timeslice) {
+  struct Done {
+    TriggerJobs& jobs;
+    TimeSlice*   timeslice;
+
+    // also when process throws; the executor counts the error
+    ~Done() {
+      jobs.data.trigger_done(timeslice, jobs.type);
+      std::lock_guard<std::mutex> lock(jobs.mutex);
+      --jobs.running;
+      jobs.cv.notify_all();
+    };
+  } done = { *this, timeslice };
+
+  process(*timeslice);
+}
+
+void TriggerJobs::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [this]() { return running == 0; });
+}
@@ -0,0 +1,58 @@
+#ifndef TRIGGER_JOBS_H
+#define TRIGGER_JOBS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+#include "Executor.h"
+#include "TimeSlice.h"
+
+class DataModel;
+
+// Runs a trigger over the timeslices of DataModel::trigger_queues[type]: each
+// timeslice is processed by a job in DataModel::executor, which then marks
+// the timeslice as done with DataModel::trigger_done. At most `max_jobs`
+// timeslices are in flight, so that a slow trigger leaves its backlog in the
+// trigger queue rather than in the executor. Jobs of an `urgent` trigger
+// are run before the other jobs of the executor.
+class TriggerJobs {
+  public:
+    typedef std::function<void(TimeSlice&)> Process;
+
+    TriggerJobs(
+        DataModel&   data,
+        trigger_type type,
+        Process      process,
+        unsigned     max_jobs,
+        bool         urgent = false
+    );
+
+    // Waits for the jobs in flight
+    ~TriggerJobs() { wait(); };
+
+    // Takes the next timeslice and submits its job, waiting up to `timeout`
+    // for a free job slot and for a timeslice. Returns false on timeout.
+    bool dispatch(std::chrono::milliseconds timeout);
+
+    // Waits until all submitted jobs complete
+    void wait();
+
+    Executor::Stats stats;
+
+  private:
+    DataModel&   data;
+    trigger_type type;
+    Process      process;
+    unsigned     max_jobs;
+    bool         urgent;
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    unsigned                running = 0;
+
+    void run(TimeSlice* timeslice);
+};
+
+#endif
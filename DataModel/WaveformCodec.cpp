@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "WaveformCodec.h"
+
+namespace {
+
+const size_t lanes = WaveformCodec::lanes;
+
+// Number of 16-bit words in a lane of a block of `rows` values per lane of
+// `width` bits
+inline size_t lane_words(size_t rows, unsigned width) {
+  return (rows * width + 15) / 16;
+}
+
+// Packs `rows` rows of `lanes` values of `width` bits. `out` receives
+// lane_words(rows, width) rows of `lanes` words.
+void pack(const uint16_t* values, size_t rows, unsigned width, uint16_t* out) {
+  uint16_t word[lanes] = {};
+  unsigned bits = 0; // used in word
+  for (size_t r = 0; r < rows; ++r) {
+    const uint16_t* row = values + r * lanes;
+    for (size_t l = 0; l < lanes; ++l) word[l] |= row[l] << bits;
+    bits += width;
+    if (bits >= 16) {
+      bits -= 16;
+      for (size_t l = 0; l < lanes; ++l) {
+        out[l]  = word[l];
+        // the bits of the value which did not fit
+        word[l] = bits ? row[l] >> (width - bits) : 0;
+      };
+      out += lanes;
+    };
+  };
+  if (bits)
+    for (size_t l = 0; l < lanes; ++l) out[l] = word[l];
+}
+
+void unpack(const uint16_t* in, size_t rows, unsigned width, uint16_t* values) {
+  if (width == 0) {
+    std::fill(values, values + rows * lanes, 0);
+    return;
+  };
+  uint16_t mask = width == 16 ? 0xffff : (1 << width) - 1;
+  uint16_t word[lanes] = {};
+  unsigned bits = 0; // left in word
+  for (size_t r = 0; r < rows; ++r) {
+    uint16_t* row = values + r * lanes;
+    if (bits >= width) {
+      for (size_t l = 0; l < lanes; ++l) {
+        row[l]  = word[l] & mask;
+        word[l] = width == 16 ? 0 : word[l] >> width;
+      };
+      bits -= width;
+      continue;
+    };
+    // bits of the next word taken by this row
+    unsigned used = width - bits;
+    for (size_t l = 0; l < lanes; ++l) {
+      uint16_t next = in[l];
+      row[l]  = (word[l] | next << bits) & mask;
+      word[l] = used == 16 ? 0 : next >> used;
+    };
+    in += lanes;
+    bits = 16 - used;
+  };
+}
+
+}; // namespace
+
+WaveformCodec::WaveformCodec(size_t block): block_(block) {
+  if (block % lanes || block == 0 || block > 4096)
+    throw std::invalid_argument(
+        "WaveformCodec: block size must be a multiple of 8 up to 4096"
+    );
+  deltas.resize(block);
+}
+
+void WaveformCodec::encode(
+    const uint16_t* samples, size_t n, std::vector<uint8_t>& out
+) {
+  uint32_t block = block_;
+  size_t start = out.size();
+  out.resize(start + sizeof(block));
+  std::memcpy(out.data() + start, &block, sizeof(block));
+
+  uint16_t last = 0;
+  for (size_t i = 0; i < n; i += block) {
+    size_t m = std::min<size_t>(block, n - i);
+    size_t rows = (m + lanes - 1) / lanes;
+
+    uint16_t bits = 0;
+    for (size_t j = 0; j < m; ++j) {
+      uint16_t delta = samples[i + j] - last;
+      last = samples[i + j];
+      // zigzag: the sign goes to the lowest bit
+      deltas[j] = delta << 1 ^ (delta & 0x8000 ? 0xffff : 0);
+      bits |= deltas[j];
+    };
+    std::fill(deltas.begin() + m, deltas.begin() + rows * lanes, 0);
+    unsigned width = bits ? 32 - __builtin_clz(bits) : 0;
+
+    size_t words = lane_words(rows, width) * lanes;
+    size_t end = out.size();
+    out.resize(end + 1 + words * sizeof(uint16_t));
+    out[end] = width;
+    // `out` may be unaligned for uint16_t
+    if (words) {
+      uint16_t packed[4096];
+      pack(deltas.data(), rows, width, packed);
+      std::memcpy(out.data() + end + 1, packed, words * sizeof(uint16_t));
+    };
+  };
+}
+
+void WaveformCodec::decode(
+    const uint8_t* data, size_t size, size_t n, uint16_t* samples
+) {
+  uint32_t block;
+  if (size < sizeof(block))
+    throw std::runtime_error("WaveformCodec: truncated data");
+  std::memcpy(&block, data, sizeof(block));
+  if (block % lanes || block == 0 || block > 4096)
+    throw std::runtime_error("WaveformCodec: invalid block size");
+  const uint8_t* p   = data + sizeof(block);
+  const uint8_t* end = data + size;
+
+  uint16_t words[4096];
+  uint16_t deltas[4096];
+  uint16_t last = 0;
+  for (size_t i = 0; i < n; i += block) {
+    size_t m = std::min<size_t>(block, n - i);
+    size_t rows = (m + lanes - 1) / lanes;
+    if (p == end) throw std::runtime_error("WaveformCodec: truncated data");
+    unsigned width = *p++;
+    if (width > 16) throw std::runtime_error("WaveformCodec: invalid width");
+    size_t length = lane_words(rows, width) * lanes * sizeof(uint16_t);
+    if (static_cast<size_t>(end - p) < length)
+      throw std::runtime_error("WaveformCodec: truncated data");
+    std::memcpy(words, p, length);
+    p += length;
+
+    unpack(words, rows, width, deltas);
+    for (size_t j = 0; j < m; ++j) {
+      uint16_t delta = deltas[j];
+      last += (delta >> 1) ^ -(delta & 1);
+      samples[i + j] = last;
+    };
+  };
+}
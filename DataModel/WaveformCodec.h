@@ -0,0 +1,46 @@
+#ifndef WAVEFORM_CODEC_H
+#define WAVEFORM_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless compression of waveform samples. The samples are replaced with
+// their differences from the previous sample (zigzag encoded, modulo 2^16),
+// which stay within a few bits on the baseline. The differences are
+// bit-packed in blocks of `block` samples with the width of the largest
+// difference in the block.
+//
+// Within a block, the values are packed vertically in 8 lanes: value i goes
+// to lane i % 8, and the lanes are packed side by side into interleaved
+// 16-bit words. All lanes shift by the same amount at each step, so that
+// the packing loops compile into 128-bit vector instructions.
+//
+// Encoded samples: uint32_t block size, then the blocks, each one byte of
+// the bit width followed by 8 lanes * ceil(block / 8 * width / 16) 16-bit
+// words. The last block is padded with zeros.
+class WaveformCodec {
+  public:
+    static const size_t lanes = 8;
+
+    // Throws std::invalid_argument unless `block` is a multiple of `lanes`
+    // between 8 and 4096
+    explicit WaveformCodec(size_t block = 64);
+
+    size_t block() const { return block_; };
+
+    // Appends `n` encoded samples to `out`
+    void encode(const uint16_t* samples, size_t n, std::vector<uint8_t>& out);
+
+    // Decodes `n` samples from `size` bytes at `data`. Throws
+    // std::runtime_error on malformed data.
+    static void decode(
+        const uint8_t* data, size_t size, size_t n, uint16_t* samples
+    );
+
+  private:
+    size_t block_;
+    std::vector<uint16_t> deltas; // of a block
+};
+
+#endif
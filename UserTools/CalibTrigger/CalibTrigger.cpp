@@ -1,108 +1,111 @@
+#include "DataModel.h"
+
 #include "CalibTrigger.h"
 
-CalibTrigger_args::CalibTrigger_args():Thread_args(){}
+CalibTrigger::CalibTrigger(): Tool() {}
+
+// Calibration hits closer than `window` to the first one of a group form one
+// trigger at the time of the first hit. One pass over the hits.
+void CalibTrigger::process(TimeSlice& timeslice) {
+  const ChannelMask& channels = m_data->calib_channels;
+  // this trigger's lane; no other thread writes it
+  std::vector<uint64_t>& triggers = timeslice.lane(trigger_type::calib);
+  uint64_t end = 0; // end of the current group
+  for (auto& hit : timeslice.hits) {
+    if (!channels.test(hit.channel)) continue;
+    if (triggers.empty() || hit.time >= end) {
+      triggers.push_back(hit.time);
+      end = hit.time + window;
+    };
+  };
+
+  ntriggers += triggers.size();
+}
 
-CalibTrigger_args::~CalibTrigger_args(){}
+void CalibTrigger::ThreadArgs::report() {
+  auto now = std::chrono::steady_clock::now();
+  if (now < next_report) return;
+  next_report = now + tool.monitor_interval;
 
+  Store data;
+  tool.jobs->stats.report(data, "calib_jobs");
+  data.Set("calib_triggers", tool.ntriggers.load());
 
-CalibTrigger::CalibTrigger():Tool(){}
+  std::string json;
+  data >> json;
+  tool.m_data->services->SendMonitoringData(std::move(json), "CalibTrigger");
+}
 
+void CalibTrigger::ThreadArgs::execute() {
+  if (tool.m_data->services) report();
+  tool.jobs->dispatch(std::chrono::milliseconds(100));
+}
 
-bool CalibTrigger::Initialise(std::string configfile, DataModel &data){
+void CalibTrigger::Thread(Thread_args* args) {
+  static_cast<ThreadArgs*>(args)->execute();
+}
+
+bool CalibTrigger::Initialise(std::string configfile, DataModel& data) {
   InitialiseTool(data);
   InitialiseConfiguration(configfile);
 
-  if(!m_variables.Get("verbose",m_verbose)) m_verbose=1;
-
-  m_util=new Utilities();
-
-  m_threadnum=0;
-  CreateThread();
-  
-  m_freethreads=1;
+  if (!m_variables.Get("verbose", m_verbose)) m_verbose = 1;
+
+  unsigned executor_threads = 0;
+  m_variables.Get("executor_threads", executor_threads);
+  m_data->executor.start(executor_threads);
+
+  unsigned max_jobs = m_data->executor.size();
+  m_variables.Get("max_jobs", max_jobs);
+
+  // Calibration channels, a mask of 16 channels per digitizer
+  m_data->calib_channels.clear();
+  for (unsigned digitizer = 0; digitizer < 16; ++digitizer) {
+    std::string mask;
+    std::string key = "digitizer_" + std::to_string(digitizer) + "_mask";
+    if (!m_variables.Get(key, mask)) continue;
+    unsigned long bits = std::stoul(mask, nullptr, 0);
+    for (unsigned channel = 0; channel < 16; ++channel)
+      if (bits >> channel & 1)
+        m_data->calib_channels.set(channel | digitizer << 4);
+  };
+  if (m_data->calib_channels.empty())
+    *m_log << ToolFramework::MsgL(1, m_verbose)
+           << "CalibTrigger: no calibration channels configured" << std::endl;
+
+  double ns = 1000;
+  m_variables.Get("window", ns);
+  window = Hit::time_from_ns(ns);
+
+  int seconds = 5;
+  m_variables.Get("monitor_interval", seconds);
+  monitor_interval = std::chrono::seconds(seconds);
+
+  jobs.reset(
+      new TriggerJobs(
+        *m_data,
+        trigger_type::calib,
+        [this](TimeSlice& timeslice) { process(timeslice); },
+        max_jobs,
+        true // calibration data goes ahead of the physics triggers
+      )
+  );
+
+  thread = new ThreadArgs(*this);
+  util.CreateThread("CalibTrigger", &Thread, thread);
 
   ExportConfiguration();
   return true;
 }
 
-
-bool CalibTrigger::Execute(){
-
-  for(unsigned int i=0; i<args.size(); i++){
-    if(args.at(i)->busy==0){
-      std::cout<<"reply="<<args.at(i)->message<<std::endl;
-      args.at(i)->message="Hi";
-      args.at(i)->busy=1;
-      break;
-    }
-
-  }
-
-  m_freethreads=0;
-  int lastfree=0;
-  for(unsigned int i=0; i<args.size(); i++){
-    if(args.at(i)->busy==0){
-      m_freethreads++;
-      lastfree=i; 
-    }
-  }
-
-  if(m_freethreads<1) CreateThread();
-  if(m_freethreads>1) DeleteThread(lastfree);
-  
-  std::cout<<"free threads="<<m_freethreads<<":"<<args.size()<<std::endl;
-  
-  sleep(1);
-  
+bool CalibTrigger::Execute() {
   return true;
 }
 
-
-bool CalibTrigger::Finalise(){
-
-  for(unsigned int i=0;i<args.size();i++) m_util->KillThread(args.at(i));
-  
-  args.clear();
-  
-  delete m_util;
-  m_util=0;
-
+bool CalibTrigger::Finalise() {
+  util.KillThread(thread);
+  delete thread;
+  thread = nullptr;
+  jobs.reset(); // waits for the jobs in flight
   return true;
 }
-
-void CalibTrigger::CreateThread(){
-
-  CalibTrigger_args* tmparg=new CalibTrigger_args();
-  tmparg->busy=0;
-  tmparg->message="";
-  args.push_back(tmparg);
-  std::stringstream tmp;
-  tmp<<"T"<<m_threadnum;
-  m_util->CreateThread(tmp.str(), &Thread, args.at(args.size()-1));
-  m_threadnum++;
-
-}
-
- void CalibTrigger::DeleteThread(int pos){
-
-   m_util->KillThread(args.at(pos));
-   delete args.at(pos);
-   args.at(pos)=0;
-   args.erase(args.begin()+(pos-1));
-
- }
-
-void CalibTrigger::Thread(Thread_args* arg){
-
-  CalibTrigger_args* args=reinterpret_cast<CalibTrigger_args*>(arg);
-
-  if(!args->busy) usleep(100);
-  else{ 
-
-    args->message="Hello";
-    sleep(10);
-
-    args->busy=0;
-  }
-
-}
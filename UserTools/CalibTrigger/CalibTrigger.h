@@ -1,66 +1,61 @@
 #ifndef CalibTrigger_H
 #define CalibTrigger_H
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
 #include <iostream>
 
 #include "Tool.h"
-#include "Utilities.h"
 
-using namespace ToolFramework;
+// Calibration trigger: fires on hits in the calibration pulser channels
+// (DataModel::calib_channels). Trigger times are recorded in the trigger lane
+// of the timeslice (TimeSlice::lane). The jobs are urgent in the executor, so
+// that calibration data is not delayed by the physics triggers.
+// Timeslices are taken from DataModel::trigger_queues[trigger_type::calib] and
+// processed in DataModel::executor.
+class CalibTrigger: public ToolFramework::Tool {
+  public:
+    CalibTrigger();
 
-/**
- * \struct CalibTrigger_args
- *
- * This is a struct to place data you want your thread to acess or exchange with it. The idea is the datainside is only used by the threa\
-d and so will be thread safe
-*
-* $Author: B.Richards $
-* $Date: 2019/05/28 10:44:00 $
-*/
+    bool Initialise(std::string configfile, DataModel& data);
+    bool Execute();
+    bool Finalise();
 
-struct CalibTrigger_args:Thread_args{
+  private:
+    struct ThreadArgs : Thread_args {
+      CalibTrigger& tool;
 
-  CalibTrigger_args();
-  ~CalibTrigger_args();
-  bool busy;
-  std::string message;
+      // next time to send the monitoring data
+      std::chrono::steady_clock::time_point next_report;
 
-};
-
-/**
- * \class CalibTrigger
- *
- * This is a template for a Tool that dynamically more or less threads, such that there is always 1 available thread.This can therefore be used to scale to your worklaod, however be carefull when using more than one of these tools and to apply upperlimits if necessary both locally within this tool and globally so that more threads than is practical are created causing massive inefficency. Please fill out the descripton and author information.
- *
- * $Author: B.Richards $
- * $Date: 2019/05/28 10:44:00 $
- */
-
-class CalibTrigger: public Tool {
+      ThreadArgs(CalibTrigger& tool):
+        tool(tool), next_report(std::chrono::steady_clock::now())
+      {};
 
+      void report();
+      void execute();
+    };
 
- public:
+    // calibration hits within the window form one trigger; in units of
+    // Hit::time
+    uint64_t window;
 
-  CalibTrigger(); ///< Simple constructor
-  bool Initialise(std::string configfile,DataModel &data); ///< Initialise Function for setting up Tool resorces. @param configfile The path and name of the dynamic configuration file to read in. @param data A reference to the transient data class used to pass information between Tools.
-  bool Execute(); ///< Executre function used to perform Tool perpose. 
-  bool Finalise(); ///< Finalise funciton used to clean up resorces.
+    std::unique_ptr<TriggerJobs> jobs;
 
+    std::atomic<uint64_t> ntriggers {0};
 
- private:
+    std::chrono::seconds monitor_interval;
 
-  void CreateThread(); ///< Function to Create Thread
-  void DeleteThread(int pos); ///< Function to delete thread @param pos is the position in the args vector below
+    Utilities util;
+    ThreadArgs* thread = nullptr;
 
-  static void Thread(Thread_args* arg); ///< Function to be run by the thread in a loop. Make sure not to block in it
-  Utilities* m_util; ///< Pointer to utilities class to help with threading
-  std::vector<CalibTrigger_args*> args; ///< Vector of thread args (also holds pointers to the threads)
-
-  int m_freethreads; ///< Keeps track of free threads
-  unsigned long m_threadnum; ///< Counter for unique naming of threads
+    // Processes a timeslice. Runs in the executor, possibly on several
+    // timeslices at once.
+    void process(TimeSlice& timeslice);
 
+    static void Thread(Thread_args*);
 };
 
-
 #endif
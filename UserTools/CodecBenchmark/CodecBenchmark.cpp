@@ -0,0 +1,232 @@
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include "DataModel.h"
+#include "HitCodec.h"
+#include "WaveformCodec.h"
+
+#include "CodecBenchmark.h"
+
+CodecBenchmark::CodecBenchmark(): Tool() {}
+
+// Hits of `channels` channels with Poisson distributed times at `rate` Hz
+// per channel, in time order, with the charges spread around the typical
+// values of a PMT pulse and a baseline fixed per channel within a few counts.
+// The first `nwaveforms` hits get waveforms: a negative pulse with the
+// amplitude following the charge on top of the baseline with Gaussian noise.
+void CodecBenchmark::generate() {
+  size_t nhits = 1000000;
+  m_variables.Get("nhits", nhits);
+  unsigned channels = 64;
+  m_variables.Get("channels", channels);
+  if (channels == 0 || channels > 256)
+    throw std::runtime_error("CodecBenchmark: channels must be in 1..256");
+  double rate = 10000;
+  m_variables.Get("rate", rate);
+  size_t nwaveforms = 20000;
+  m_variables.Get("waveforms", nwaveforms);
+  nwaveforms = std::min(nwaveforms, nhits);
+  uint16_t waveform_length = 280;
+  m_variables.Get("waveform_length", waveform_length);
+
+  std::mt19937_64 random(1);
+  std::exponential_distribution<double> gap(rate * channels);
+  std::uniform_int_distribution<unsigned> channel(0, channels - 1);
+  std::normal_distribution<double> charge(400, 150);
+  std::uniform_int_distribution<int> noise(-2, 2);
+  std::normal_distribution<double> sample_noise(0, 2);
+
+  std::vector<uint16_t> baselines(channels);
+  for (auto& baseline : baselines) baseline = 14000 + noise(random) * 100;
+
+  hits.resize(nhits);
+  waveforms.resize(nwaveforms * waveform_length);
+  double time = 0;
+  for (size_t i = 0; i < nhits; ++i) {
+    Hit& hit = hits[i];
+    time += gap(random) * 1e9;
+    hit.time            = Hit::time_from_ns(time);
+    hit.channel         = channel(random);
+    hit.charge_long     = std::max(charge(random), 0.);
+    hit.charge_short    = hit.charge_long / 4;
+    hit.baseline        = baselines[hit.channel] + noise(random);
+    hit.waveform_length = i < nwaveforms ? waveform_length : 0;
+    hit.waveform_offset = i < nwaveforms ? i * waveform_length : 0;
+
+    uint16_t* waveform = waveforms.data() + hit.waveform_offset;
+    double amplitude = hit.charge_long / 4.;
+    for (size_t j = 0; j < hit.waveform_length; ++j) {
+      // pulse starting at 1/4 of the waveform with the rise time of 8
+      // samples
+      double t = (double(j) - waveform_length / 4) / 8;
+      double pulse = t > 0 ? amplitude * t * exp(1 - t) : 0;
+      waveform[j] = std::max(hit.baseline - pulse + sample_noise(random), 0.);
+    };
+  };
+}
+
+// Encodes and decodes the hits in chunks of `chunk` hits (all of them if 0),
+// each chunk on its own as the hits of a timeslice are.
+bool CodecBenchmark::benchmark_hits(size_t chunk) {
+  typedef std::chrono::steady_clock clock;
+  size_t nhits = hits.size();
+  if (chunk == 0 || chunk > nhits) chunk = nhits;
+  if (chunk == 0) return true;
+
+  std::vector<uint8_t> encoded;
+  std::vector<size_t> offsets; // of the encoded chunks in `encoded`
+  auto start = clock::now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    encoded.clear();
+    offsets.clear();
+    for (size_t j = 0; j < nhits; j += chunk) {
+      offsets.push_back(encoded.size());
+      HitCodec::encode(
+          hits.data() + j, std::min(chunk, nhits - j), encoded
+      );
+    };
+    offsets.push_back(encoded.size());
+  };
+  double encode_time = std::chrono::duration<double>(
+      clock::now() - start
+  ).count() / iterations;
+
+  std::vector<Hit> decoded(nhits);
+  start = clock::now();
+  for (unsigned i = 0; i < iterations; ++i)
+    for (size_t j = 0, k = 0; j < nhits; j += chunk, ++k)
+      HitCodec::decode(
+          encoded.data() + offsets[k],
+          offsets[k + 1] - offsets[k],
+          std::min(chunk, nhits - j),
+          decoded.data() + j
+      );
+  double decode_time = std::chrono::duration<double>(
+      clock::now() - start
+  ).count() / iterations;
+
+  for (size_t i = 0; i < nhits; ++i) {
+    const Hit& a = hits[i];
+    const Hit& b = decoded[i];
+    if (
+        a.time != b.time
+        || a.charge_short != b.charge_short
+        || a.charge_long != b.charge_long
+        || a.baseline != b.baseline
+        || a.channel != b.channel
+        || a.waveform_length != b.waveform_length
+    ) {
+      log(0)
+        << "CodecBenchmark: HitCodec: hit " << i
+        << " differs after decoding" << std::endl;
+      return false;
+    };
+  };
+
+  // size of the hit columns in the file without compression
+  size_t raw = nhits * (
+      sizeof(uint64_t) + 4 * sizeof(uint16_t) + sizeof(uint8_t)
+  );
+  log(0)
+    << "CodecBenchmark: HitCodec: " << nhits << " hits in chunks of "
+    << chunk << ", "
+    << double(encoded.size()) / nhits << " B/hit, ratio "
+    << double(raw) / encoded.size()
+    << ", encode " << nhits / encode_time * 1e-6 << " Mhit/s ("
+    << raw / encode_time * 1e-6 << " MB/s), decode "
+    << nhits / decode_time * 1e-6 << " Mhit/s ("
+    << raw / decode_time * 1e-6 << " MB/s)"
+    << std::endl;
+  return true;
+}
+
+bool CodecBenchmark::benchmark_waveforms(size_t block) {
+  typedef std::chrono::steady_clock clock;
+  size_t n = waveforms.size();
+  if (n == 0) return true;
+
+  WaveformCodec codec(block);
+  std::vector<uint8_t> encoded;
+  auto start = clock::now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    encoded.clear();
+    codec.encode(waveforms.data(), n, encoded);
+  };
+  double encode_time = std::chrono::duration<double>(
+      clock::now() - start
+  ).count() / iterations;
+
+  std::vector<uint16_t> decoded(n);
+  start = clock::now();
+  for (unsigned i = 0; i < iterations; ++i)
+    WaveformCodec::decode(encoded.data(), encoded.size(), n, decoded.data());
+  double decode_time = std::chrono::duration<double>(
+      clock::now() - start
+  ).count() / iterations;
+
+  if (decoded != waveforms) {
+    log(0)
+      << "CodecBenchmark: WaveformCodec: samples differ after decoding"
+      << std::endl;
+    return false;
+  };
+
+  size_t raw = n * sizeof(uint16_t);
+  log(0)
+    << "CodecBenchmark: WaveformCodec: block " << block << ", " << n
+    << " samples, " << 8. * encoded.size() / n << " bit/sample, ratio "
+    << double(raw) / encoded.size()
+    << ", encode " << raw / encode_time * 1e-6 << " MB/s, decode "
+    << raw / decode_time * 1e-6 << " MB/s"
+    << std::endl;
+  return true;
+}
+
+bool CodecBenchmark::Initialise(std::string configfile, DataModel& data) {
+  InitialiseTool(data);
+  InitialiseConfiguration(configfile);
+
+  if (!m_variables.Get("verbose", m_verbose)) m_verbose = 1;
+
+  iterations = 10;
+  m_variables.Get("iterations", iterations);
+  if (iterations == 0) iterations = 1;
+
+  std::string chunks = "1000,10000,0";
+  m_variables.Get("hit_chunks", chunks);
+  std::stringstream ss(chunks);
+  hit_chunks.clear();
+  std::string chunk;
+  while (std::getline(ss, chunk, ','))
+    hit_chunks.push_back(std::stoul(chunk));
+
+  std::string blocks = "16,32,64,128,256";
+  m_variables.Get("waveform_blocks", blocks);
+  ss.clear();
+  ss.str(blocks);
+  waveform_blocks.clear();
+  std::string block;
+  while (std::getline(ss, block, ','))
+    waveform_blocks.push_back(std::stoul(block));
+
+  generate();
+
+  ExportConfiguration();
+  return true;
+}
+
+bool CodecBenchmark::Execute() {
+  bool ok = true;
+  for (auto chunk : hit_chunks) ok = benchmark_hits(chunk) && ok;
+  for (auto block : waveform_blocks) ok = benchmark_waveforms(block) && ok;
+  return ok;
+}
+
+bool CodecBenchmark::Finalise() {
+  hits.clear();
+  waveforms.clear();
+  return true;
+}
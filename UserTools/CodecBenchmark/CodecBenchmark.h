@@ -0,0 +1,37 @@
+#ifndef CodecBenchmark_H
+#define CodecBenchmark_H
+
+#include <string>
+#include <iostream>
+#include <vector>
+
+#include "Tool.h"
+
+// Measures the compression ratio and the encoding and decoding throughput of
+// the data codecs (HitCodec, WaveformCodec) on generated hits, and checks
+// that the decoded data match the original. Run with configfiles/benchmark.
+class CodecBenchmark: public ToolFramework::Tool {
+  public:
+    CodecBenchmark();
+
+    bool Initialise(std::string configfile, DataModel& data);
+    bool Execute();
+    bool Finalise();
+
+  private:
+    std::vector<Hit>      hits;
+    std::vector<uint16_t> waveforms; // in the order of the hits
+    unsigned iterations;
+    std::vector<size_t> hit_chunks;
+    std::vector<size_t> waveform_blocks;
+
+    void generate();
+    bool benchmark_hits(size_t chunk);
+    bool benchmark_waveforms(size_t block);
+
+    ToolFramework::Logging& log(int level) {
+      return *m_log << ToolFramework::MsgL(level, m_verbose);
+    };
+};
+
+#endif
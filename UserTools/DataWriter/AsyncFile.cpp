@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "AsyncFile.h"
+
+const size_t AsyncFile::alignment;
+
+AsyncFile::Sync AsyncFile::parse_sync(const std::string& sync) {
+  if (sync == "none")     return Sync::none;
+  if (sync == "close")    return Sync::close;
+  if (sync == "buffer")   return Sync::buffer;
+  if (sync == "interval") return Sync::interval;
+  throw std::runtime_error("AsyncFile: unknown fsync policy: " + sync);
+}
+
+void AsyncFile::Stats::report(
+    ToolFramework::Store& data, const std::string& prefix
+) {
+  data.Set(prefix + "_bytes",      bytes.load());
+  data.Set(prefix + "_writes",     writes.load());
+  data.Set(prefix + "_write_time", write_time * 1e-9);
+  data.Set(prefix + "_write_time_max", max_write_time.exchange(0) * 1e-9);
+  data.Set(prefix + "_sync_time",  sync_time * 1e-9);
+  data.Set(prefix + "_stall_time", stall_time * 1e-9);
+}
+
+AsyncFile::AsyncFile(
+    size_t   buffer_size,
+    unsigned buffers,
+    bool     direct,
+    Sync     sync,
+    std::chrono::milliseconds sync_interval
+):
+  // O_DIRECT writes must be a multiple of the block size
+  buffer_size(
+      std::max((buffer_size + alignment - 1) & ~(alignment - 1), alignment)
+  ),
+  direct(direct),
+  sync(sync),
+  sync_interval(sync_interval)
+{
+  storage.resize(std::max(buffers, 2u));
+  for (auto& buffer : storage) {
+    void* data;
+    if (posix_memalign(&data, alignment, this->buffer_size) != 0)
+      throw std::bad_alloc();
+    buffer.data = static_cast<char*>(data);
+    buffer.size = 0;
+  };
+}
+
+AsyncFile::~AsyncFile() {
+  close();
+  for (auto& buffer : storage) ::free(buffer.data);
+}
+
+void AsyncFile::open(const std::string& path) {
+  close();
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  if (direct) flags |= O_DIRECT;
+  fd = ::open(path.c_str(), flags, 0644);
+  if (fd < 0)
+    throw std::runtime_error(
+        "AsyncFile: failed to open " + path + ": " + strerror(errno)
+    );
+  this->path = path;
+
+  failed       = false;
+  error_number = 0;
+  closing      = false;
+  free.clear();
+  filled.clear();
+  for (auto& buffer : storage) {
+    buffer.size = 0;
+    free.push_back(&buffer);
+  };
+  current = nullptr;
+
+  thread = std::thread(&AsyncFile::run, this);
+}
+
+bool AsyncFile::close() {
+  if (fd < 0) return true;
+
+  if (current && current->size) submit(current);
+  current = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closing = true;
+  };
+  filled_cv.notify_one();
+  thread.join();
+
+  if (sync != Sync::none && !failed) do_sync();
+  if (::close(fd) != 0 && !failed) {
+    error_number = errno;
+    failed = true;
+  };
+  fd = -1;
+  return !failed;
+}
+
+std::string AsyncFile::error() const {
+  return failed ? path + ": " + strerror(error_number) : std::string();
+}
+
+void AsyncFile::write(const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size) {
+    if (!current) {
+      auto start = std::chrono::steady_clock::now();
+      std::unique_lock<std::mutex> lock(mutex);
+      if (free.empty()) {
+        free_cv.wait(lock, [this]() { return !free.empty(); });
+        stats.stall_time += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start
+        ).count();
+      };
+      current = free.back();
+      free.pop_back();
+    };
+
+    size_t n = std::min(size, buffer_size - current->size);
+    std::memcpy(current->data + current->size, bytes, n);
+    current->size += n;
+    bytes += n;
+    size  -= n;
+
+    if (current->size == buffer_size) {
+      submit(current);
+      current = nullptr;
+    };
+  };
+}
+
+void AsyncFile::submit(Buffer* buffer) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    filled.push_back(buffer);
+  };
+  filled_cv.notify_one();
+}
+
+// I/O thread
+void AsyncFile::run() {
+  auto next_sync = std::chrono::steady_clock::now() + sync_interval;
+  while (true) {
+    Buffer* buffer;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (sync == Sync::interval)
+        filled_cv.wait_until(
+            lock,
+            next_sync,
+            [this]() { return closing || !filled.empty(); }
+        );
+      else
+        filled_cv.wait(lock, [this]() { return closing || !filled.empty(); });
+      if (filled.empty()) {
+        if (closing) return;
+        buffer = nullptr;
+      } else {
+        buffer = filled.front();
+        filled.pop_front();
+      };
+    };
+
+    if (buffer) {
+      if (!failed) write_buffer(*buffer);
+      buffer->size = 0;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        free.push_back(buffer);
+      };
+      free_cv.notify_one();
+    };
+
+    if (failed) continue;
+    if (sync == Sync::buffer && buffer)
+      do_sync();
+    else if (sync == Sync::interval) {
+      auto now = std::chrono::steady_clock::now();
+      if (now >= next_sync) {
+        do_sync();
+        next_sync = now + sync_interval;
+      };
+    };
+  };
+}
+
+// Only the last buffer of the file may be partially filled. With O_DIRECT,
+// its tail not aligned to the block size is written after clearing the flag.
+void AsyncFile::write_buffer(Buffer& buffer) {
+  auto start = std::chrono::steady_clock::now();
+
+  const char* data = buffer.data;
+  size_t size = buffer.size;
+  size_t tail = direct ? size % alignment : 0;
+  size -= tail;
+  while (size || tail) {
+    if (!size) {
+      int flags = fcntl(fd, F_GETFL);
+      fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+      size = tail;
+      tail = 0;
+    };
+    ssize_t n = ::write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      error_number = errno;
+      failed = true;
+      return;
+    };
+    data += n;
+    size -= n;
+  };
+
+  uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start
+  ).count();
+  stats.bytes += buffer.size;
+  ++stats.writes;
+  stats.write_time += time;
+  uint64_t max = stats.max_write_time;
+  while (time > max && !stats.max_write_time.compare_exchange_weak(max, time));
+}
+
+void AsyncFile::do_sync() {
+  auto start = std::chrono::steady_clock::now();
+  if (fdatasync(fd) != 0) {
+    error_number = errno;
+    failed = true;
+  };
+  stats.sync_time += std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start
+  ).count();
+}
@@ -0,0 +1,112 @@
+#ifndef ASYNC_FILE_H
+#define ASYNC_FILE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Store.h"
+
+// Output file written by a dedicated I/O thread. `write` copies the data
+// into one of `buffers` page aligned buffers of `buffer_size` bytes and
+// returns; full buffers are written to disk by the I/O thread while the
+// caller fills the next one. The caller waits only when all buffers are
+// waiting for the disk. With `direct`, the file is opened with O_DIRECT,
+// bypassing the page cache, so that the kernel does not stall the writer
+// when it flushes dirty pages.
+class AsyncFile {
+  public:
+    // When to flush the written data to the disk with fsync:
+    //   none:     never; left to the kernel
+    //   close:    when the file is closed
+    //   buffer:   after each buffer and on close
+    //   interval: every `sync_interval` and on close
+    enum class Sync { none, close, buffer, interval };
+
+    // Throws std::runtime_error on an unknown policy
+    static Sync parse_sync(const std::string& sync);
+
+    struct Stats {
+      std::atomic<uint64_t> bytes      {0};
+      std::atomic<uint64_t> writes     {0}; // buffers written
+      std::atomic<uint64_t> write_time {0}; // total buffer write time, ns
+      std::atomic<uint64_t> max_write_time {0}; // since the last report, ns
+      std::atomic<uint64_t> sync_time  {0}; // total fsync time, ns
+      std::atomic<uint64_t> stall_time {0}; // time `write` waited for a buffer, ns
+
+      // Reports the counters as <prefix>_<name>. Resets max_write_time.
+      void report(ToolFramework::Store& data, const std::string& prefix);
+    };
+
+    AsyncFile(
+        size_t   buffer_size,
+        unsigned buffers,
+        bool     direct,
+        Sync     sync,
+        std::chrono::milliseconds sync_interval
+    );
+
+    ~AsyncFile();
+
+    // Throws std::runtime_error if the file cannot be opened
+    void open(const std::string& path);
+
+    // Writes all buffered data and closes the file. Returns false if any
+    // write failed.
+    bool close();
+
+    bool is_open() const { return fd >= 0; };
+
+    // False after a write error. The data passed to `write` afterwards is
+    // discarded.
+    bool good() const { return !failed; };
+
+    std::string error() const;
+
+    void write(const void* data, size_t size);
+
+    Stats stats;
+
+  private:
+    struct Buffer {
+      char*  data;
+      size_t size;
+    };
+
+    static const size_t alignment = 4096;
+
+    size_t   buffer_size;
+    bool     direct;
+    Sync     sync;
+    std::chrono::milliseconds sync_interval;
+
+    int fd = -1;
+    std::string path;
+
+    std::vector<Buffer> storage;
+    Buffer* current = nullptr; // being filled by `write`
+
+    std::mutex              mutex;
+    std::condition_variable free_cv;   // notified when a buffer is freed
+    std::condition_variable filled_cv; // notified when a buffer is filled
+    std::vector<Buffer*>    free;
+    std::deque<Buffer*>     filled;
+    bool                    closing = false;
+
+    std::atomic<bool> failed {false};
+    int               error_number = 0;
+
+    std::thread thread;
+
+    void submit(Buffer* buffer);
+    void run();
+    void write_buffer(Buffer& buffer);
+    void do_sync();
+};
+
+#endif
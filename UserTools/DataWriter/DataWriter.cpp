@@ -1,50 +1,375 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "DataModel.h"
+
 #include "DataWriter.h"
 
-DataWriter_args::DataWriter_args():Thread_args(){}
+DataWriter::DataWriter(): Tool() {}
+
+DataWriter::Stream::Stream(
+    DataWriter& tool, unsigned id, std::string directory
+):
+  tool(tool),
+  id(id),
+  directory(std::move(directory)),
+  encoder(tool.flags, tool.waveform_block),
+  file(
+      tool.buffer_size,
+      tool.buffers,
+      tool.direct,
+      tool.sync,
+      tool.sync_interval
+  )
+{}
 
-DataWriter_args::~DataWriter_args(){}
+// Opens <directory>/<run>_<stream>_<sequence>.bdq and writes the header.
+// Throws std::runtime_error if the file cannot be opened.
+void DataWriter::Stream::open() {
+  char name[32];
+  snprintf(name, sizeof(name), "_%u_%04u.bdq", id, sequence++);
+  path = directory + '/' + tool.run + name;
+  file.open(path);
+  opened = std::chrono::steady_clock::now();
+  ++tool.files;
 
+  slice_file::FileHeader header;
+  slice_file::init(header, encoder.flags());
+  file.write(&header, sizeof(header));
+  offset = sizeof(header);
+  index.clear();
+  first_time = UINT64_MAX;
+  last_time  = 0;
+  nhits      = 0;
 
-DataWriter::DataWriter():Tool(){}
+  tool.log(2) << "DataWriter: writing " << path << std::endl;
+}
 
+// Writes the index and the trailer, closes the file and records it in the
+// catalog. After a write error the file is left without the index.
+void DataWriter::Stream::close() {
+  if (!file.is_open()) return;
 
-bool DataWriter::Initialise(std::string configfile, DataModel &data){
-  InitialiseTool(data);
-  InitialiseConfiguration(configfile);
+  if (file.good()) {
+    slice_file::FileTrailer trailer;
+    slice_file::init(trailer, offset, index.size());
+    file.write(index.data(), index.size() * sizeof(slice_file::IndexEntry));
+    file.write(&trailer, sizeof(trailer));
+  };
+  if (file.close())
+    tool.add_to_catalog(*this);
+  else
+    tool.log(0) << "DataWriter: failed to write " << file.error() << std::endl;
 
-  if(!m_variables.Get("verbose",m_verbose)) m_verbose=1;
+  index.clear();
+}
 
-  m_util=new Utilities();
-  args=new DataWriter_args();
-  
-  m_util->CreateThread("test", &Thread, args);
+void DataWriter::Stream::rotate() {
+  if (index.empty()) return;
+  if (
+      !(tool.max_file_size && offset >= tool.max_file_size)
+      && !(
+        tool.max_file_duration.count()
+        && std::chrono::steady_clock::now() - opened >= tool.max_file_duration
+      )
+  )
+    return;
 
-  ExportConfiguration();
-  return true;
+  close();
+  try {
+    open();
+  } catch (std::exception& e) {
+    tool.log(0) << "DataWriter: " << e.what() << std::endl;
+  };
 }
 
+void DataWriter::Stream::recover() {
+  auto now = std::chrono::steady_clock::now();
+  if (file.is_open()) {
+    // reports the error
+    close();
+    retry = now + tool.retry_interval;
+    return;
+  };
+  if (now < retry) return;
 
-bool DataWriter::Execute(){
+  retry = now + tool.retry_interval;
+  try {
+    open();
+  } catch (std::exception& e) {
+    tool.log(0) << "DataWriter: " << e.what() << std::endl;
+  };
+}
 
-  return true;
+void DataWriter::Stream::write(const TimeSlice& timeslice) {
+  if (!file.is_open() || !file.good()) {
+    if (tool.errors++ == 0)
+      tool.log(0)
+        << "DataWriter: failed to write "
+        << (file.is_open() ? file.error() : path) << std::endl;
+    return;
+  };
+
+  const std::vector<char>& buffer = encoder.encode(timeslice);
+  file.write(buffer.data(), buffer.size());
+
+  const std::vector<Hit>& hits = timeslice.hits;
+  slice_file::IndexEntry entry;
+  entry.offset     = offset;
+  entry.nhits      = hits.size();
+  entry.first_time = hits.empty() ? 0 : hits.front().time;
+  entry.last_time  = hits.empty() ? 0 : hits.back().time;
+  index.push_back(entry);
+  offset += buffer.size();
+  if (!hits.empty()) {
+    first_time = std::min(first_time, entry.first_time);
+    last_time  = std::max(last_time,  entry.last_time);
+  };
+  nhits += hits.size();
+
+  ++tool.timeslices;
+  tool.hits  += hits.size();
+  tool.bytes += buffer.size();
+
+  rotate();
+}
+
+void DataWriter::Stream::execute() {
+  if (id == 0 && tool.m_data->services) tool.report();
+
+  if (!healthy()) recover();
+  failed = !healthy();
+  if (failed && tool.writable()) {
+    // leave the timeslices to the other streams
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return;
+  };
+
+  std::unique_ptr<TimeSlice> timeslice;
+  {
+    std::unique_lock<std::mutex> lock(tool.m_data->write_queue_mutex);
+    auto& queue = tool.m_data->write_queue;
+    // return periodically to let the thread be stopped
+    if (
+        !tool.m_data->write_queue_cv.wait_for(
+          lock,
+          std::chrono::milliseconds(100),
+          [&queue]() { return !queue.empty(); }
+        )
+    ) {
+      lock.unlock();
+      // do not keep a file open past its duration when idle
+      rotate();
+      return;
+    };
+    timeslice = std::move(queue.front());
+    queue.pop();
+  };
+
+  // With no directory to write to, the timeslices are dropped rather than
+  // left to pile up in memory
+  if (failed)
+    ++tool.errors;
+  else
+    write(*timeslice);
+
+  tool.m_data->write_limit.remove(*timeslice);
+  timeslice->clear();
+  tool.m_data->timeslices.put(std::move(timeslice));
+}
+
+bool DataWriter::writable() const {
+  for (auto& stream : streams)
+    if (!stream->failed) return true;
+  return false;
+}
+
+void DataWriter::Thread(Thread_args* args) {
+  static_cast<Stream*>(args)->execute();
+}
+
+// Catalog line: file, first and last hit time (in units of Hit::time),
+// number of slices, number of hits, file size in bytes
+void DataWriter::add_to_catalog(const Stream& stream) {
+  std::lock_guard<std::mutex> lock(catalog_mutex);
+  catalog
+    << stream.path << ' '
+    << (stream.nhits ? stream.first_time : 0) << ' '
+    << stream.last_time << ' '
+    << stream.index.size() << ' '
+    << stream.nhits << ' '
+    << stream.offset
+       + stream.index.size() * sizeof(slice_file::IndexEntry)
+       + sizeof(slice_file::FileTrailer)
+    << std::endl;
+  if (!catalog) log(0) << "DataWriter: failed to write the catalog" << std::endl;
+}
+
+void DataWriter::report() {
+  auto now = std::chrono::steady_clock::now();
+  if (now < next_report) return;
+  double dt = std::chrono::duration<double>(
+      now - next_report + monitor_interval
+  ).count();
+  next_report = now + monitor_interval;
+
+  Store data;
+  data.Set("writer_timeslices", timeslices.load());
+  data.Set("writer_hits",       hits.load());
+  data.Set("writer_bytes",      bytes.load());
+  data.Set("writer_files",      files.load());
+  data.Set("writer_errors",     errors.load());
+
+  uint64_t written = 0;
+  for (auto& stream : streams) {
+    written += stream->file.stats.bytes;
+    std::stringstream prefix;
+    prefix << "writer_io" << stream->id;
+    stream->file.stats.report(data, prefix.str());
+  };
+  // bytes per second reaching the disks
+  data.Set("writer_rate", dt > 0 ? (written - last_bytes) / dt : 0);
+  last_bytes = written;
+  m_data->write_limit.report(data, "write");
+
+  std::string json;
+  data >> json;
+  m_data->services->SendMonitoringData(std::move(json), "DataWriter");
 }
 
+bool DataWriter::Initialise(std::string configfile, DataModel& data) {
+  InitialiseTool(data);
+  InitialiseConfiguration(configfile);
+
+  if (!m_variables.Get("verbose", m_verbose)) m_verbose = 1;
+
+  std::string directories = ".";
+  if (!m_variables.Get("directories", directories))
+    m_variables.Get("directory", directories);
+  std::string prefix = "buttondaq";
+  m_variables.Get("prefix", prefix);
 
-bool DataWriter::Finalise(){
+  char stamp[32];
+  time_t now = time(nullptr);
+  struct tm tm;
+  strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%S", localtime_r(&now, &tm));
+  run = prefix + '_' + stamp;
 
-  m_util->KillThread(args);
+  bool compress_hits = true;
+  m_variables.Get("compress_hits", compress_hits);
+  flags = compress_hits ? slice_file::hit_codec : 0;
 
-  delete args;
-  args=0;
+  bool compress_waveforms = true;
+  m_variables.Get("compress_waveforms", compress_waveforms);
+  if (compress_waveforms) flags |= slice_file::waveform_codec;
+  waveform_block = 64;
+  m_variables.Get("waveform_block", waveform_block);
 
-  delete m_util;
-  m_util=0;
+  buffer_size = 8 << 20;
+  m_variables.Get("buffer_size", buffer_size);
+  buffers = 2;
+  m_variables.Get("buffers", buffers);
+  direct = false;
+  m_variables.Get("direct", direct);
+  std::string sync = "close";
+  m_variables.Get("fsync", sync);
+  this->sync = AsyncFile::parse_sync(sync);
+  double sync_interval = 1;
+  m_variables.Get("fsync_interval", sync_interval);
+  this->sync_interval = std::chrono::milliseconds(
+      static_cast<long>(sync_interval * 1000)
+  );
 
+  max_file_size = uint64_t(2) << 30;
+  m_variables.Get("max_file_size", max_file_size);
+  int seconds = 0;
+  m_variables.Get("max_file_duration", seconds);
+  max_file_duration = std::chrono::seconds(seconds);
+
+  seconds = 10;
+  m_variables.Get("retry_interval", seconds);
+  retry_interval = std::chrono::seconds(seconds);
+  QueueLimit& limit = m_data->write_limit;
+  limit.max_bytes = 1ul << 30;
+  m_variables.Get("write_max_hits",  limit.max_hits);
+  m_variables.Get("write_max_bytes", limit.max_bytes);
+  std::string policy = "block";
+  m_variables.Get("write_policy", policy);
+  limit.policy = QueueLimit::parse_policy(policy);
+  limit.spill_path = "write.spill";
+  m_variables.Get("write_spill", limit.spill_path);
+
+  seconds = 5;
+  m_variables.Get("monitor_interval", seconds);
+  monitor_interval = std::chrono::seconds(seconds);
+  next_report = std::chrono::steady_clock::now();
+
+  std::stringstream ss(directories);
+  std::string directory;
+  streams.clear();
+  while (std::getline(ss, directory, ','))
+    if (!directory.empty())
+      streams.emplace_back(new Stream(*this, streams.size(), directory));
+  if (streams.empty())
+    throw std::runtime_error("DataWriter: no output directories");
+
+  std::string catalog_path
+    = streams.front()->directory + '/' + run + ".catalog";
+  m_variables.Get("catalog", catalog_path);
+  catalog.open(catalog_path, std::ios::app);
+  if (!catalog)
+    throw std::runtime_error("DataWriter: failed to open " + catalog_path);
+  catalog << "# file first_time last_time slices hits bytes" << std::endl;
+
+  for (auto& stream : streams) stream->open();
+  for (auto& stream : streams)
+    util.CreateThread("DataWriter", &Thread, stream.get());
+  m_data->writing = true;
+
+  ExportConfiguration();
+  return true;
+}
+
+bool DataWriter::Execute() {
   return true;
 }
 
-void DataWriter::Thread(Thread_args* arg){
+bool DataWriter::Finalise() {
+  m_data->writing = false;
+  for (auto& stream : streams) util.KillThread(stream.get());
+
+  // write the timeslices left in the queue to the streams which can take
+  // them
+  {
+    std::vector<Stream*> healthy;
+    for (auto& stream : streams)
+      if (stream->healthy()) healthy.push_back(stream.get());
 
-  DataWriter_args* args=reinterpret_cast<DataWriter_args*>(arg);
+    std::lock_guard<std::mutex> lock(m_data->write_queue_mutex);
+    auto& queue = m_data->write_queue;
+    if (!queue.empty() && healthy.empty())
+      log(0)
+        << "DataWriter: no directory to write the last " << queue.size()
+        << " timeslices to" << std::endl;
+    for (size_t i = 0; !queue.empty(); ++i) {
+      if (healthy.empty())
+        ++errors;
+      else
+        healthy[i % healthy.size()]->write(*queue.front());
+      m_data->write_limit.remove(*queue.front());
+      queue.front()->clear();
+      m_data->timeslices.put(std::move(queue.front()));
+      queue.pop();
+    };
+  };
 
+  for (auto& stream : streams) stream->close();
+  streams.clear();
+  catalog.close();
+  return true;
 }
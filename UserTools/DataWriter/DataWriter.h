@@ -1,56 +1,130 @@
 #ifndef DataWriter_H
 #define DataWriter_H
 
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <iostream>
+#include <vector>
 
 #include "Tool.h"
 
-using namespace ToolFramework;
-
-/**
- * \struct DataWriter_args_args
- *
- * This is a struct to place data you want your thread to access or exchange with it. The idea is the datainside is only used by the threa\d and so will be thread safe
- *
- * $Author: B.Richards $
- * $Date: 2019/05/28 10:44:00 $
- */
-
-struct DataWriter_args:Thread_args{
-
-  DataWriter_args();
-  ~DataWriter_args();
-
+#include "AsyncFile.h"
+#include "SliceEncoder.h"
+#include "SliceFile.h"
+
+// Stores the timeslices of DataModel::write_queue in files of columns (see
+// SliceFile.h): each timeslice is written as separate arrays of hit times,
+// charges, baselines, channels and waveforms, so that a reader can load only
+// the columns it needs. The hit columns and the waveforms are compressed
+// with HitCodec and WaveformCodec unless disabled. The index of the slices
+// with their offsets and time ranges is written at the end of each file.
+//
+// Output is striped across the configured directories (separate disks): each
+// directory has a stream with its own thread taking timeslices from the
+// queue, so a faster disk takes more. A stream starts a new file when the
+// current one reaches max_file_size or max_file_duration. Each closed file
+// is recorded in the run catalog with its time range. The files are written
+// by separate I/O threads (AsyncFile), so that a slow disk does not hold the
+// timeslices. A stream whose file fails stops taking timeslices, leaving
+// them to the other streams, and tries a new file every retry_interval.
+// When all the streams have failed, the timeslices are dropped.
+class DataWriter: public ToolFramework::Tool {
+  public:
+    DataWriter();
+
+    bool Initialise(std::string configfile, DataModel& data);
+    bool Execute();
+    bool Finalise();
+
+  private:
+    // Output to one directory
+    struct Stream : Thread_args {
+      DataWriter&  tool;
+      unsigned     id;
+      std::string  directory;
+      SliceEncoder encoder;
+      AsyncFile    file;
+
+      std::string path;
+      unsigned    sequence = 0; // number of files opened
+      std::chrono::steady_clock::time_point opened;
+      uint64_t    offset = 0; // of the end of the file
+      std::vector<slice_file::IndexEntry> index;
+      // of the slices in the file, in units of Hit::time
+      uint64_t    first_time;
+      uint64_t    last_time;
+      uint64_t    nhits;
+      // next attempt to open a file after a failure
+      std::chrono::steady_clock::time_point retry;
+      // the file failed and is not reopened yet; set by the stream thread
+      std::atomic<bool> failed {false};
+
+      Stream(DataWriter& tool, unsigned id, std::string directory);
+
+      bool healthy() const { return file.is_open() && file.good(); };
+
+      void open();
+      void close();
+      // Closes the failed file and opens a new one when retry comes
+      void recover();
+      // Starts a new file if the current one is due
+      void rotate();
+      void write(const TimeSlice& timeslice);
+      void execute();
+    };
+
+    // prefix of the file names: <prefix>_<date>T<time>
+    std::string run;
+    std::vector<std::unique_ptr<Stream>> streams;
+
+    // slice_file flags and WaveformCodec block size
+    uint32_t flags;
+    size_t   waveform_block;
+
+    // AsyncFile parameters
+    size_t          buffer_size;
+    unsigned        buffers;
+    bool            direct;
+    AsyncFile::Sync sync;
+    std::chrono::milliseconds sync_interval;
+
+    // new file conditions; 0 to disable
+    uint64_t max_file_size;
+    std::chrono::seconds max_file_duration;
+
+    // period of the attempts to open a new file after a failure
+    std::chrono::seconds retry_interval;
+
+    std::ofstream catalog;
+    std::mutex    catalog_mutex;
+
+    std::chrono::seconds monitor_interval;
+    std::chrono::steady_clock::time_point next_report;
+    uint64_t last_bytes = 0;
+
+    // counters
+    std::atomic<uint64_t> timeslices {0};
+    std::atomic<uint64_t> hits       {0};
+    std::atomic<uint64_t> bytes      {0};
+    std::atomic<uint64_t> files      {0};
+    std::atomic<uint64_t> errors     {0}; // timeslices failed to write
+
+    Utilities util;
+
+    // True if any stream can take timeslices
+    bool writable() const;
+    void report();
+    void add_to_catalog(const Stream& stream);
+
+    ToolFramework::Logging& log(int level) {
+      return *m_log << ToolFramework::MsgL(level, m_verbose);
+    };
+
+    static void Thread(Thread_args*);
 };
 
-/**
- * \class DataWriter
- *
- * This is a template for a Tool that produces a single thread that can be assigned a function seperate to the main thread. Please fill out the descripton and author information.
-*
-* $Author: B.Richards $
-* $Date: 2019/05/28 10:44:00 $
-*/
-
-class DataWriter: public Tool {
-
-
- public:
-
-  DataWriter(); ///< Simple constructor
-  bool Initialise(std::string configfile,DataModel &data); ///< Initialise Function for setting up Tool resorces. @param configfile The path and name of the dynamic configuration file to read in. @param data A reference to the transient data class used to pass information between Tools.
-  bool Execute(); ///< Executre function used to perform Tool perpose. 
-  bool Finalise(); ///< Finalise funciton used to clean up resorces.
-
-
- private:
-
-  static void Thread(Thread_args* arg); ///< Function to be run by the thread in a loop. Make sure not to block in it
-  Utilities* m_util;  ///< Pointer to utilities class to help with threading
-  DataWriter_args* args; ///< thread args (also holds pointer to the thread)
-
-};
-
-
 #endif
@@ -0,0 +1,123 @@
+#include <cstring>
+
+#include "HitCodec.h"
+
+#include "SliceEncoder.h"
+
+SliceEncoder::SliceEncoder(uint32_t flags, size_t waveform_block):
+  flags_(flags), waveform_codec_(waveform_block)
+{}
+
+// The slice columns are filled in the layout of slice_file::SliceLayout.
+// The waveforms are copied in the order of the hits, so that the waveform of
+// a hit starts at the sum of waveform_length of the preceding hits.
+const std::vector<char>& SliceEncoder::encode(const TimeSlice& timeslice) {
+  using namespace slice_file;
+
+  const std::vector<Hit>& hits = timeslice.hits;
+  const std::vector<TriggerRecord>& triggers = timeslice.positive_trggers;
+  const std::vector<Event>& events = timeslice.events;
+
+  SliceHeader header;
+  header.nhits    = hits.size();
+  header.nsamples = 0;
+  for (auto& hit : hits) header.nsamples += hit.waveform_length;
+  header.ntriggers  = triggers.size();
+  header.nevents    = events.size();
+  header.first_time = hits.empty() ? 0 : hits.front().time;
+  header.last_time  = hits.empty() ? 0 : hits.back().time;
+
+  if (flags_ & hit_codec) {
+    encoded.clear();
+    HitCodec::encode(hits.data(), hits.size(), encoded);
+    header.hits_size = encoded.size();
+  };
+
+  header.waveforms_size = header.nsamples * sizeof(uint16_t);
+  if (flags_ & waveform_codec) {
+    samples.clear();
+    for (auto& hit : hits) {
+      const uint16_t* waveform = timeslice.waveform(hit);
+      samples.insert(samples.end(), waveform, waveform + hit.waveform_length);
+    };
+    encoded_waveforms.clear();
+    waveform_codec_.encode(samples.data(), samples.size(), encoded_waveforms);
+    header.waveforms_size = encoded_waveforms.size();
+  };
+
+  SliceLayout layout(header, flags_);
+  if (!(flags_ & hit_codec)) header.hits_size = layout.waveforms - layout.hits;
+  header.size = layout.size;
+  buffer.assign(layout.size, 0); // zero padding between the columns
+  char* base = buffer.data();
+  std::memcpy(base, &header, sizeof(header));
+
+  if (flags_ & hit_codec)
+    std::memcpy(base + layout.hits, encoded.data(), encoded.size());
+  else {
+    uint64_t* time = reinterpret_cast<uint64_t*>(base + layout.time);
+    uint16_t* charge_short
+      = reinterpret_cast<uint16_t*>(base + layout.charge_short);
+    uint16_t* charge_long
+      = reinterpret_cast<uint16_t*>(base + layout.charge_long);
+    uint16_t* baseline = reinterpret_cast<uint16_t*>(base + layout.baseline);
+    uint8_t*  channel  = reinterpret_cast<uint8_t*>(base + layout.channel);
+    uint16_t* waveform_length
+      = reinterpret_cast<uint16_t*>(base + layout.waveform_length);
+    for (size_t i = 0; i < hits.size(); ++i) {
+      const Hit& hit = hits[i];
+      time[i]            = hit.time;
+      charge_short[i]    = hit.charge_short;
+      charge_long[i]     = hit.charge_long;
+      baseline[i]        = hit.baseline;
+      channel[i]         = hit.channel;
+      waveform_length[i] = hit.waveform_length;
+    };
+  };
+
+  if (flags_ & waveform_codec)
+    std::memcpy(
+        base + layout.waveforms,
+        encoded_waveforms.data(),
+        encoded_waveforms.size()
+    );
+  else {
+    uint16_t* waveforms
+      = reinterpret_cast<uint16_t*>(base + layout.waveforms);
+    for (auto& hit : hits)
+      if (hit.waveform_length) {
+        std::memcpy(
+            waveforms,
+            timeslice.waveform(hit),
+            hit.waveform_length * sizeof(uint16_t)
+        );
+        waveforms += hit.waveform_length;
+      };
+  };
+
+  uint64_t* trigger_time
+    = reinterpret_cast<uint64_t*>(base + layout.trigger_time);
+  uint8_t* trigger_type_
+    = reinterpret_cast<uint8_t*>(base + layout.trigger_type);
+  for (size_t i = 0; i < triggers.size(); ++i) {
+    trigger_time[i]  = triggers[i].time;
+    trigger_type_[i] = static_cast<uint8_t>(triggers[i].type);
+  };
+
+  uint64_t* event_start = reinterpret_cast<uint64_t*>(base + layout.event_start);
+  uint64_t* event_end   = reinterpret_cast<uint64_t*>(base + layout.event_end);
+  uint32_t* event_first_hit
+    = reinterpret_cast<uint32_t*>(base + layout.event_first_hit);
+  uint32_t* event_nhits
+    = reinterpret_cast<uint32_t*>(base + layout.event_nhits);
+  uint8_t* event_triggers
+    = reinterpret_cast<uint8_t*>(base + layout.event_triggers);
+  for (size_t i = 0; i < events.size(); ++i) {
+    event_start[i]     = events[i].start;
+    event_end[i]       = events[i].end;
+    event_first_hit[i] = events[i].first_hit;
+    event_nhits[i]     = events[i].nhits;
+    event_triggers[i]  = events[i].triggers;
+  };
+  return buffer;
+}
@@ -0,0 +1,36 @@
+#ifndef SLICE_ENCODER_H
+#define SLICE_ENCODER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "SliceFile.h"
+#include "TimeSlice.h"
+#include "WaveformCodec.h"
+
+// Serialises timeslices into the slice layout of SliceFile.h, compressing
+// the hits and the waveforms according to the slice_file flags. Keeps its
+// buffers between the calls, so one encoder is needed per writing thread.
+class SliceEncoder {
+  public:
+    SliceEncoder(uint32_t flags, size_t waveform_block);
+
+    uint32_t flags() const { return flags_; };
+
+    // Returns the encoded slice, valid until the next call
+    const std::vector<char>& encode(const TimeSlice& timeslice);
+
+  private:
+    uint32_t      flags_;
+    WaveformCodec waveform_codec_;
+
+    // encoded timeslice
+    std::vector<char> buffer;
+    // encoded hits
+    std::vector<uint8_t> encoded;
+    // waveforms in the order of the hits and encoded
+    std::vector<uint16_t> samples;
+    std::vector<uint8_t>  encoded_waveforms;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "DPPPSD.h"
+
+static void malformed(const char* what) {
+  throw std::runtime_error(std::string("DPP-PSD decoder: ") + what);
+}
+
+size_t dpp_psd::decode(
+    const uint32_t* data,
+    size_t          size,
+    uint8_t         board,
+    uint16_t        nsamples,
+    HitBlock&       block
+) {
+  size_t nevents = 0;
+  const uint32_t* end = data + size;
+  while (data < end) {
+    if (data[0] >> 28 != board_aggregate_tag)
+      malformed("invalid board aggregate header");
+
+    size_t words = data[0] & 0x0fffffff;
+    if (words < board_header_words || words > static_cast<size_t>(end - data))
+      malformed("invalid board aggregate size");
+
+    const uint32_t* aggregate_end = data + words;
+    uint32_t couples = data[1] & 0xff;
+    const uint32_t* p = data + board_header_words;
+    for (uint32_t couple = 0; couple < 8; ++couple) {
+      if (!(couples & 1 << couple)) continue;
+
+      if (aggregate_end - p < channel_header_words)
+        malformed("truncated channel aggregate");
+
+      size_t channel_words = p[0] & 0x7fffffff;
+      if (
+          channel_words < channel_header_words
+          || channel_words > static_cast<size_t>(aggregate_end - p)
+      )
+        malformed("invalid channel aggregate size");
+
+      const uint32_t* channel_end = p + channel_words;
+      uint32_t format = p[1];
+      p += channel_header_words;
+
+      uint32_t waveform_words
+        = format & format_waveform ? (format & 0xffff) * 4 : 0;
+      // samples of the first trace are interleaved with the second one in
+      // the dual trace mode
+      uint32_t trace_samples
+        = format & format_dual_trace ? waveform_words : waveform_words * 2;
+      uint32_t event_words
+        = 1
+        + waveform_words
+        + (format & format_extras ? 1 : 0)
+        + (format & format_charge ? 1 : 0);
+
+      size_t n = (channel_end - p) / event_words;
+      size_t first = block.hits.size();
+      block.hits.resize(first + n);
+      Hit* hit = block.hits.data() + first;
+      size_t offset = block.waveforms.size();
+      block.waveforms.resize(offset + n * nsamples);
+      uint8_t channel = couple << 1 | board << 4;
+      for (size_t i = 0; i < n; ++i, ++hit) {
+        uint32_t tag = *p++;
+        hit->channel  = channel | tag >> 31;
+        hit->baseline = 0;
+        hit->waveform_offset = offset;
+        hit->waveform_length = nsamples;
+
+        const uint32_t* waveform = p;
+        p += waveform_words;
+
+        uint32_t extras = format & format_extras ? *p++ : 0;
+        hit->time = static_cast<uint64_t>(tag & 0x7fffffff) << 32 | extras;
+
+        if (format & format_charge) {
+          uint32_t charge = *p++;
+          hit->charge_short = charge & 0x7fff;
+          hit->charge_long  = charge >> 16;
+        } else {
+          hit->charge_short = 0;
+          hit->charge_long  = 0;
+        };
+
+        if (nsamples) {
+          uint16_t* sample = block.waveforms.data() + offset;
+          uint16_t  m = std::min<uint32_t>(nsamples, trace_samples);
+          if (format & format_dual_trace)
+            for (uint16_t s = 0; s < m; ++s)
+              *sample++ = waveform[s] & 0x3fff;
+          else {
+            uint16_t s = 0;
+            for (; s + 1 < m; s += 2, ++waveform) {
+              *sample++ = *waveform       & 0x3fff;
+              *sample++ = *waveform >> 16 & 0x3fff;
+            };
+            if (s < m) *sample++ = *waveform & 0x3fff;
+          };
+          std::fill(sample, block.waveforms.data() + offset + nsamples, 0);
+          offset += nsamples;
+        };
+      };
+      nevents += n;
+      p = channel_end;
+    };
+
+    data = aggregate_end;
+  };
+
+  return nevents;
+}
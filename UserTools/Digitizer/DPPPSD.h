@@ -0,0 +1,64 @@
+#ifndef DPPPSD_H
+#define DPPPSD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Hit.h"
+
+// Data format of the DPP-PSD firmware for x725 and x730 digitizers.
+// See UM4380_725-730_DPP_PSD_Registers, "Data format".
+//
+// The readout buffer is a sequence of board aggregates. A board aggregate is
+// a 4 words header followed by channel aggregates, one per enabled channel
+// couple listed in the dual channel mask. A channel aggregate is a 2 words
+// header followed by the events of both channels of the couple:
+//
+//   board aggregate header:
+//     word 0: [31:28] 0b1010, [27:0] aggregate size in words
+//     word 1: [31:27] board id, [26] board fail, [7:0] dual channel mask
+//     word 2: [22:0] aggregate counter
+//     word 3: aggregate time tag
+//
+//   channel aggregate header:
+//     word 0: [31] 1, [30:0] aggregate size in words
+//     word 1: [31] dual trace, [30] charge enabled, [29] time enabled,
+//             [28] extras enabled, [27] waveform enabled,
+//             [26:24] extras option, [15:0] number of samples / 8
+//
+//   event:
+//     word 0: [31] odd channel of the couple, [30:0] trigger time tag
+//     waveform: number of samples / 2 words, two 14 bit samples per word
+//     extras (if enabled): [31:16] extended time, [9:0] fine time
+//               (the Digitizer tool configures extras option 0b010)
+//     charge: [31:16] long gate charge, [15] pileup, [14:0] short gate charge
+namespace dpp_psd {
+  static const uint32_t board_aggregate_tag    = 0xA;
+  static const uint32_t board_header_words     = 4;
+  static const uint32_t channel_header_words   = 2;
+
+  static const uint32_t format_dual_trace      = 1u << 31;
+  static const uint32_t format_charge          = 1u << 30;
+  static const uint32_t format_time            = 1u << 29;
+  static const uint32_t format_extras          = 1u << 28;
+  static const uint32_t format_waveform        = 1u << 27;
+  static const uint32_t format_extras_option   = 7u << 24;
+  static const uint32_t format_extras_time     = 2u << 24;
+
+  // Decodes the events in the readout buffer and appends them to `block`.
+  // Hits get channel `channel | board << 4`, time `TimeTag << 32 | Extras`
+  // (see Reformatter for the decoding of the time) and, if `nsamples` is not
+  // zero, the first `nsamples` samples of the first analog trace (padded with
+  // zeros if the board sent less). Returns the number of decoded events.
+  // Throws std::runtime_error if the data is malformed.
+  size_t decode(
+      const uint32_t* data,
+      size_t          size, // in words
+      uint8_t         board,
+      uint16_t        nsamples,
+      HitBlock&       block
+  );
+};
+
+#endif
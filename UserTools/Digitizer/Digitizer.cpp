@@ -3,19 +3,33 @@
 #include "DataModel.h"
 
 #include "Digitizer.h"
+#include "DPPPSD.h"
 
 void Digitizer::connect() {
   std::stringstream ss;
   std::string string;
   std::string link_string;
   std::unordered_map<int, ReadoutThread*> thread_partition;
+  // emulated and replayed boards
+  std::unordered_map<int, ReadoutThread*> software_partition;
+
+  std::string replay_directory = ".";
+  bool replay_realtime = false;
+  m_variables.Get("replay_directory", replay_directory);
+  m_variables.Get("replay_realtime",  replay_realtime);
+
   for (int i = 0; ; ++i) {
     ss.str({});
     ss << "digitizer_" << i << "_link";
     if (!m_variables.Get(ss.str(), link_string)) break;
 
-    CAEN_DGTZ_ConnectionType link;
-    if (link_string == "usb")
+    bool emulated = link_string == "emulator";
+    bool replayed = link_string == "replay";
+
+    CAEN_DGTZ_ConnectionType link = CAEN_DGTZ_USB;
+    if (emulated || replayed)
+      ;
+    else if (link_string == "usb")
       link = CAEN_DGTZ_USB;
     else if (link_string == "optical")
       link = CAEN_DGTZ_OpticalLink;
@@ -41,8 +55,12 @@ void Digitizer::connect() {
     ss << "digitizer_" << i << "_link_arg";
     uint32_t arg;
     if (!m_variables.Get(ss.str(), arg)) {
-      ss << " is not found in the configuration file";
-      throw std::runtime_error(ss.str());
+      if (!emulated && !replayed) {
+        ss << " is not found in the configuration file";
+        throw std::runtime_error(ss.str());
+      };
+      // each emulated or replayed board gets its own readout thread by default
+      arg = i;
     };
 
     ss.str({});
@@ -59,36 +77,63 @@ void Digitizer::connect() {
       ss >> std::hex >> vme;
     };
 
-    info()
-      << "connecting to digitizer " << i
-      << " (link = " << link_string
-      << ", arg = " << arg
-      << ", conet = " << conet
-      << ", vme = " << std::hex << vme << std::dec
-      << ")..."
-      << std::flush;
+    std::unique_ptr<caen::Digitizer> digitizer;
+    std::unique_ptr<DigitizerEmulator> emulator;
+    std::unique_ptr<RawReplay> replay;
+    if (emulated) {
+      info() << "creating emulated digitizer " << i << "..." << std::flush;
+      emulator.reset(new DigitizerEmulator(emulator_parameters(i)));
+    } else if (replayed) {
+      ss.str({});
+      ss << "digitizer_" << i << "_replay";
+      std::string path;
+      if (!m_variables.Get(ss.str(), path))
+        path = replay_directory + "/digitizer_" + std::to_string(i) + ".raw";
+      info()
+        << "replaying digitizer " << i << " from " << path << "..."
+        << std::flush;
+      replay.reset(new RawReplay(path, replay_realtime));
+    } else {
+      info()
+        << "connecting to digitizer " << i
+        << " (link = " << link_string
+        << ", arg = " << arg
+        << ", conet = " << conet
+        << ", vme = " << std::hex << vme << std::dec
+        << ")..."
+        << std::flush;
+      digitizer.reset(new caen::Digitizer(link, arg, conet, vme));
+    };
     digitizers.emplace_back(
         Board {
           static_cast<uint8_t>(i),
-          caen::Digitizer(link, arg, conet, vme),
-          caen::Digitizer::ReadoutBuffer(),
+          std::move(digitizer),
+          std::move(emulator),
+          std::move(replay),
           caen::Digitizer::DPPEvents<CAEN_DGTZ_DPP_PSD_Event_t>(),
-          caen::Digitizer::DPPWaveforms<CAEN_DGTZ_DPP_PSD_Waveforms_t>()
+          caen::Digitizer::DPPWaveforms<CAEN_DGTZ_DPP_PSD_Waveforms_t>(),
+          {},
+          {},
+          nullptr,
+          nullptr
         }
     );
+    Board& board = digitizers.back();
     info() << "success" << std::endl;
 
     m_data->active_digitizers.push_back(0);
 
-    auto thread = thread_partition.find(arg);
-    if (thread == thread_partition.end()) {
+    auto& partition
+      = emulated || replayed ? software_partition : thread_partition;
+    auto thread = partition.find(arg);
+    if (thread == partition.end()) {
       threads.emplace_back(*this);
-      thread = thread_partition.emplace(arg, &threads.back()).first;
+      thread = partition.emplace(arg, &threads.back()).first;
     };
-    thread->second->digitizers.push_back(&digitizers.back());
+    thread->second->digitizers.push_back(&board);
 
-    if (m_verbose > 2) {
-      auto& i = digitizers.back().digitizer.info();
+    if (board.digitizer && m_verbose > 2) {
+      auto& i = board.digitizer->info();
       log(3)
         << "model name: " << i.ModelName << '\n'
         << "model: " << i.Model << '\n'
@@ -101,6 +146,44 @@ void Digitizer::connect() {
   };
 }
 
+DigitizerEmulator::Parameters Digitizer::emulator_parameters(int board) {
+  // Every parameter "emulator_<name>" can be overridden for a particular board
+  // with "digitizer_<board>_emulator_<name>"
+  std::stringstream ss;
+  ss << "digitizer_" << board << "_emulator_";
+  std::string prefix = ss.str();
+
+  DigitizerEmulator::Parameters p;
+  p.seed = board;
+
+#define GET(name, field) \
+  m_variables.Get("emulator_" name, p.field); \
+  m_variables.Get(prefix + name, p.field)
+
+  double rate = p.rate[0];
+  m_variables.Get("emulator_rate", rate);
+  m_variables.Get(prefix + "rate", rate);
+  for (uint32_t c = 0; c < DigitizerEmulator::nchannels; ++c) {
+    p.rate[c] = rate;
+    m_variables.Get(prefix + "channel_" + std::to_string(c) + "_rate", p.rate[c]);
+  };
+
+  GET("burst_period",   burst_period);
+  GET("burst_duration", burst_duration);
+  GET("burst_factor",   burst_factor);
+  GET("drift",          drift);
+  GET("offset",         offset);
+  GET("realtime",       realtime);
+  GET("read_interval",  read_interval);
+  GET("max_events",     max_events);
+  GET("charge",         charge);
+  GET("seed",           seed);
+
+#undef GET
+
+  return p;
+}
+
 void Digitizer::configure() {
   CAEN_DGTZ_DPP_PSD_Params_t params;
   params.trgho    = 0;
@@ -149,6 +232,21 @@ void Digitizer::configure() {
     params.trgc[i]  = params.trgc[0];
   };
 
+  std::string decoder = "native";
+  m_variables.Get("decoder", decoder);
+  if (decoder == "caen")
+    caen_decoder = true;
+  else if (decoder == "native")
+    caen_decoder = false;
+  else
+    throw std::runtime_error("unknown decoder: " + decoder);
+
+  m_variables.Get("readout_buffers", readout_buffers);
+  if (readout_buffers == 0) readout_buffers = 1;
+
+  std::string record;
+  m_variables.Get("record", record);
+
   bool waveforms = false;
   m_variables.Get("waveforms_enabled", waveforms);
 
@@ -172,12 +270,10 @@ void Digitizer::configure() {
   m_variables.Get("pre_trigger_size", pre_trigger_size);
 
   std::string string;
-  int i = 0;
   for (auto& board : digitizers) {
+    int i = board.id;
     info() << "configuring digitizer " << i << "... " << std::flush;
 
-    auto& digitizer = board.digitizer;
-
     std::stringstream ss;
     ss << "digitizer_" << i << "_channels";
     uint16_t channels = 0xFFFF;
@@ -189,6 +285,39 @@ void Digitizer::configure() {
       channels = mask;
     };
 
+    for (unsigned b = 0; b < readout_buffers; ++b) {
+      board.buffers.emplace_back(new Buffer());
+      board.buffers.back()->board = &board;
+      board.free.push_back(board.buffers.back().get());
+    };
+
+    // A replayed board is not recorded again: its recording may be the very
+    // file it would overwrite
+    if (!record.empty() && !board.replay)
+      board.recorder.reset(
+          new RawRecorder(
+            record + "/digitizer_" + std::to_string(i) + ".raw", board.id
+          )
+      );
+
+    if (board.replay) {
+      info() << "success" << std::endl;
+      continue;
+    };
+
+    if (board.emulator) {
+      board.emulator->configure(
+          channels,
+          nsamples,
+          pre_trigger_size,
+          polarity == CAEN_DGTZ_PulsePolarityNegative
+      );
+      info() << "success" << std::endl;
+      continue;
+    };
+
+    auto& digitizer = *board.digitizer;
+
     digitizer.reset();
 
     digitizer.setDPPAcquisitionMode(
@@ -226,20 +355,57 @@ void Digitizer::configure() {
         digitizer.setChannelPulsePolarity(channel, polarity);
       };
 
-    board.buffer.allocate(digitizer);
-    board.events.allocate(digitizer);
-    if (waveforms) board.waveforms.allocate(digitizer);
+    for (auto& buffer : board.buffers) buffer->readout.allocate(digitizer);
+    if (caen_decoder) {
+      board.events.allocate(digitizer);
+      if (waveforms) board.waveforms.allocate(digitizer);
+    };
 
     info() << "success" << std::endl;
   };
 }
 
 void Digitizer::run_readout() {
+  int poll_min    = 10;
+  int poll_max    = 10000;
+  size_t target   = 65536;
+  m_variables.Get("readout_poll_min", poll_min);
+  m_variables.Get("readout_poll_max", poll_max);
+  m_variables.Get("readout_target",   target);
+
+  size_t queue = 1024;
+  m_variables.Get("raw_readout_queue", queue);
+
+  QueueLimit& limit = m_data->raw_readout_limit;
+  limit.max_bytes = 1ul << 30;
+  m_variables.Get("raw_readout_max_hits",  limit.max_hits);
+  m_variables.Get("raw_readout_max_bytes", limit.max_bytes);
+  std::string policy = "block";
+  m_variables.Get("raw_readout_policy", policy);
+  limit.policy = QueueLimit::parse_policy(policy);
+  limit.spill_path = "raw_readout.spill";
+  m_variables.Get("raw_readout_spill", limit.spill_path);
+
   std::stringstream ss;
-  for (size_t i = 0; i < threads.size(); ++i) {
+  size_t i = 0;
+  for (auto& thread : threads) {
+    thread.scheduler.min    = std::chrono::microseconds(poll_min);
+    thread.scheduler.max    = std::chrono::microseconds(poll_max);
+    thread.scheduler.target = target;
+
+    // One producer per link: the link thread, or its decoder thread
+    RawReadout::Queue* q = m_data->raw_readout.add(queue);
+    for (auto board : thread.digitizers) board->queue = q;
+
     ss.str({});
-    ss << "Digitizer " << i;
-    util.CreateThread(ss.str(), &readout_thread, &threads[i]);
+    ss << "Digitizer " << i++;
+    util.CreateThread(ss.str(), &readout_thread, &thread);
+
+    if (readout_buffers > 1) {
+      thread.decoder = new DecodeThread(thread);
+      ss << " decoder";
+      util.CreateThread(ss.str(), &decode_thread, thread.decoder);
+    };
   };
 }
 
@@ -252,22 +418,83 @@ void Digitizer::run_monitor() {
   util.CreateThread("Digitizer monitor", &monitor_thread, monitor);
 }
 
-// Read data from the board and put it into m_data.raw_readout
-void Digitizer::readout(Board& board) {
-  board.digitizer.readData(CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT, board.buffer);
-  if (board.digitizer.getNumEvents(board.buffer) == 0) return;
+const uint32_t* Digitizer::Buffer::data() const {
+  if (!board->digitizer) return emulated.data();
+  return reinterpret_cast<const uint32_t*>(readout.data);
+}
+
+size_t Digitizer::Buffer::size() const {
+  if (!board->digitizer) return emulated.size();
+  return readout.size / sizeof(uint32_t);
+}
+
+// Put the hits into the raw readout queue of the board link, waiting for
+// the consumer if the queue is full
+void Digitizer::push(Board& board, std::unique_ptr<HitBlock> hits) {
+  QueueLimit& limit = m_data->raw_readout_limit;
+  while (limit.full()) {
+    if (limit.policy != QueueLimit::Policy::block) {
+      limit.discard(*hits);
+      hits->clear();
+      m_data->hit_blocks.put(std::move(hits));
+      return;
+    };
+    if (stopping) return;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  };
+
+  limit.add(*hits);
+  while (!board.queue->push(hits)) {
+    if (stopping) {
+      limit.remove(*hits);
+      return;
+    };
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  };
+}
+
+// Read data from the board into the buffer, recording it if requested
+void Digitizer::read(Buffer& buffer) {
+  Board& board = *buffer.board;
+  if (board.emulator)
+    board.emulator->readData(buffer.emulated);
+  else if (board.replay) {
+    bool finished = board.replay->finished();
+    board.replay->readData(buffer.emulated);
+    if (!finished && board.replay->finished())
+      info()
+        << "replay of digitizer " << static_cast<int>(board.id)
+        << " finished after " << board.replay->frames() << " buffers"
+        << std::endl;
+  } else
+    board.digitizer->readData(
+        CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT, buffer.readout
+    );
+
+  if (board.recorder && buffer.size() != 0)
+    board.recorder->record(buffer.data(), buffer.size());
+}
+
+// Decode the data with CAENDigitizer library
+void Digitizer::decode_caen(Buffer& buffer) {
+  Board& board = *buffer.board;
+  caen::Digitizer& digitizer = *board.digitizer;
+  if (digitizer.getNumEvents(buffer.readout) == 0) return;
 
-  board.digitizer.getEvents(board.buffer, board.events);
+  digitizer.getEvents(buffer.readout, board.events);
   uint32_t nhits = 0;
   for (uint32_t channel = 0;
-       channel < board.digitizer.info().Channels;
+       channel < digitizer.info().Channels;
        ++channel)
     nhits += board.events.nevents(channel);
 
-  std::unique_ptr<std::vector<Hit>> hits(new std::vector<Hit>(nhits));
-  auto hit = hits->begin();
+  std::unique_ptr<HitBlock> hits = m_data->hit_blocks.get();
+  hits->hits.resize(nhits);
+  hits->waveforms.resize(nhits * nsamples);
+  auto hit = hits->hits.begin();
+  uint32_t offset = 0;
   for (uint32_t channel = 0;
-       channel < board.digitizer.info().Channels;
+       channel < digitizer.info().Channels;
        ++channel)
   {
     uint8_t id = channel | board.id << 4;
@@ -288,32 +515,108 @@ void Digitizer::readout(Board& board) {
       hit->baseline     = 0;
 #endif
       hit->channel      = id;
+      hit->waveform_offset = offset;
+      hit->waveform_length = nsamples;
       if (nsamples) {
         board.events.decode(event, board.waveforms);
         uint16_t* waveform = board.waveforms.waveforms()->Trace1;
-        hit->waveform.insert(
-            hit->waveform.end(), waveform, waveform + nsamples
+        std::copy(
+            waveform, waveform + nsamples, hits->waveforms.begin() + offset
         );
+        offset += nsamples;
       };
       ++hit;
     };
   };
 
-  std::lock_guard<std::mutex> lock(m_data->raw_readout_mutex);
-  if (!m_data->raw_readout)
-    m_data->raw_readout.reset(new std::list<std::unique_ptr<std::vector<Hit>>>());
-  m_data->raw_readout->push_back(std::move(hits));
+  push(board, std::move(hits));
+}
+
+// Decode the data and put it into m_data.raw_readout
+void Digitizer::decode(Buffer& buffer) {
+  if (caen_decoder && buffer.board->digitizer) {
+    decode_caen(buffer);
+    return;
+  };
+
+  if (buffer.size() == 0) return;
+
+  // Decode straight from the readout buffer into a recycled hit block
+  std::unique_ptr<HitBlock> hits = m_data->hit_blocks.get();
+  dpp_psd::decode(buffer.data(), buffer.size(), buffer.board->id, nsamples, *hits);
+  push(*buffer.board, std::move(hits));
+}
+
+// Read data from the board and put it into m_data.raw_readout. Returns the
+// number of bytes read.
+size_t Digitizer::readout(Board& board) {
+  Buffer& buffer = *board.buffers.front();
+  read(buffer);
+  size_t size = buffer.size() * sizeof(uint32_t);
+  decode(buffer);
+  // The replay has no more data: let the Reformatter send the windows
+  // waiting for this board
+  if (size == 0 && board.replay && board.replay->finished())
+    m_data->active_digitizers[board.id] = 0;
+  return size;
+}
+
+// Read data from the board into a free buffer and pass it to the decoder
+// thread of the link. Returns the number of bytes read.
+size_t Digitizer::readout(ReadoutThread& link, Board& board) {
+  Buffer* buffer;
+  {
+    std::unique_lock<std::mutex> lock(link.mutex);
+    if (
+        !link.free_cv.wait_for(
+          lock,
+          std::chrono::milliseconds(100),
+          [&board]() { return !board.free.empty(); }
+        )
+    )
+      return 0;
+    buffer = board.free.back();
+    board.free.pop_back();
+  };
+
+  try {
+    read(*buffer);
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(link.mutex);
+    board.free.push_back(buffer);
+    throw;
+  };
+
+  size_t size = buffer->size() * sizeof(uint32_t);
+  std::lock_guard<std::mutex> lock(link.mutex);
+  if (size == 0) {
+    board.free.push_back(buffer);
+    // As above, once the last buffers of the replay are decoded
+    if (
+        board.replay && board.replay->finished()
+        && board.free.size() == board.buffers.size()
+    )
+      m_data->active_digitizers[board.id] = 0;
+  } else {
+    link.filled.push(buffer);
+    link.filled_cv.notify_one();
+  };
+  return size;
 }
 
 void Digitizer::readout_thread(Thread_args* arg) {
   ReadoutThread* args = static_cast<ReadoutThread*>(arg);
   Digitizer& tool = args->tool;
   DataModel& data = *tool.m_data;
+  size_t bytes = 0;
   try {
     for (auto digitizer : args->digitizers)
       if (data.active_digitizers[digitizer->id])
         try {
-          tool.readout(*digitizer);
+          if (args->decoder)
+            bytes += tool.readout(*args, *digitizer);
+          else
+            bytes += tool.readout(*digitizer);
         } catch (caen::Digitizer::Error&) {
           data.active_digitizers[digitizer->id] = 0;
           throw;
@@ -321,19 +624,66 @@ void Digitizer::readout_thread(Thread_args* arg) {
   } catch (std::exception& e) {
     tool.error() << e.what() << std::endl;
   };
+
+  args->scheduler.wait(bytes);
+}
+
+void Digitizer::decode_thread(Thread_args* arg) {
+  ReadoutThread& link = static_cast<DecodeThread*>(arg)->link;
+
+  Buffer* buffer;
+  {
+    std::unique_lock<std::mutex> lock(link.mutex);
+    if (
+        !link.filled_cv.wait_for(
+          lock,
+          std::chrono::milliseconds(100),
+          [&link]() { return !link.filled.empty(); }
+        )
+    )
+      return;
+    buffer = link.filled.front();
+    link.filled.pop();
+  };
+
+  try {
+    link.tool.decode(*buffer);
+  } catch (std::exception& e) {
+    link.tool.error() << e.what() << std::endl;
+  };
+
+  {
+    std::lock_guard<std::mutex> lock(link.mutex);
+    buffer->board->free.push_back(buffer);
+  };
+  link.free_cv.notify_one();
 }
 
 void Digitizer::monitor_thread(Thread_args* arg) {
   auto monitor = static_cast<MonitorThread*>(arg);
 
   Store data;
-  int b = 0;
+  int l = 0;
+  for (auto& link : monitor->tool.threads) {
+    auto lprefix = "link_" + std::to_string(l++);
+    data.Set(lprefix + "_poll_interval", link.scheduler.interval().count());
+    data.Set(lprefix + "_rate", link.scheduler.rate());
+  };
+
+  RawReadout& raw_readout = monitor->tool.m_data->raw_readout;
+  size_t blocks = 0;
+  for (size_t i = 0; i < raw_readout.size(); ++i)
+    blocks += raw_readout[i].size();
+  data.Set("raw_readout_blocks", blocks);
+  monitor->tool.m_data->raw_readout_limit.report(data, "raw_readout");
+
   for (auto& board : monitor->tool.digitizers) {
-    auto bprefix = "digitizer_" + std::to_string(b++);
+    if (!board.digitizer) continue; // emulated boards have no temperature
+    auto bprefix = "digitizer_" + std::to_string(board.id);
     for (unsigned c = 0; c < 16; ++c)
       data.Set(
           bprefix + "_channel_" + std::to_string(c) + "_temperature",
-          board.digitizer.readTemperature(c)
+          board.digitizer->readTemperature(c)
       );
   };
 
@@ -367,7 +717,12 @@ bool Digitizer::Execute() {
         << "starting acquisition on digitizer "
         << static_cast<int>(board.id)
         << std::endl;
-      board.digitizer.SWStartAcquisition();
+      if (board.emulator)
+        board.emulator->start();
+      else if (board.replay)
+        board.replay->start();
+      else
+        board.digitizer->SWStartAcquisition();
       m_data->active_digitizers[board.id] = 1;
     };
   };
@@ -382,7 +737,14 @@ bool Digitizer::Finalise() {
     monitor = nullptr;
   };
 
-  for (auto& thread : threads) util.KillThread(&thread);
+  stopping = true;
+  for (auto& thread : threads) {
+    util.KillThread(&thread);
+    if (thread.decoder) {
+      util.KillThread(thread.decoder);
+      delete thread.decoder;
+    };
+  };
   threads.clear();
 
   for (auto& board : digitizers) {
@@ -390,8 +752,16 @@ bool Digitizer::Finalise() {
       << "stopping acquisition on digitizer "
       << static_cast<int>(board.id)
       << std::endl;
-    board.digitizer.SWStopAcquisition();
+    if (board.emulator)
+      board.emulator->stop();
+    else if (board.digitizer)
+      board.digitizer->SWStopAcquisition();
     m_data->active_digitizers[board.id] = 0;
+
+    if (board.recorder && !board.recorder->close())
+      error()
+        << "failed to record digitizer " << static_cast<int>(board.id)
+        << ": " << board.recorder->error() << std::endl;
   };
   digitizers.clear(); // disconnect from the digitizers
 
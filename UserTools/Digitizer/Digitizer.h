@@ -1,9 +1,14 @@
 #ifndef Digitizer_H
 #define Digitizer_H
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <queue>
 #include <string>
 #include <vector>
 
@@ -11,6 +16,10 @@
 
 #include "Tool.h"
 
+#include "DigitizerEmulator.h"
+#include "PollScheduler.h"
+#include "RawRecording.h"
+
 class Digitizer: public ToolFramework::Tool {
   public:
     bool Initialise(std::string configfile, DataModel&);
@@ -18,21 +27,67 @@ class Digitizer: public ToolFramework::Tool {
     bool Finalise();
 
   private:
+    struct Board;
+
+    // Data read from a board
+    struct Buffer {
+      Board*                         board;
+      caen::Digitizer::ReadoutBuffer readout;  // hardware boards
+      std::vector<uint32_t>          emulated; // emulated and replayed boards
+
+      const uint32_t* data() const;
+      size_t          size() const; // in words
+    };
+
     struct Board {
       uint8_t                                                      id;
-      caen::Digitizer                                              digitizer;
-      caen::Digitizer::ReadoutBuffer                               buffer;
+      std::unique_ptr<caen::Digitizer>                             digitizer;
+      // not null when the board is emulated (digitizer is null then)
+      std::unique_ptr<DigitizerEmulator>                           emulator;
+      // not null when the board is replayed from a recording (digitizer is
+      // null then)
+      std::unique_ptr<RawReplay>                                   replay;
       caen::Digitizer::DPPEvents<CAEN_DGTZ_DPP_PSD_Event_t>        events;
       caen::Digitizer::DPPWaveforms<CAEN_DGTZ_DPP_PSD_Waveforms_t> waveforms;
+
+      // readout_buffers buffers
+      std::vector<std::unique_ptr<Buffer>> buffers;
+      // buffers available for reading (see ReadoutThread::mutex)
+      std::vector<Buffer*> free;
+
+      // raw readout queue of the board link
+      RawReadout::Queue* queue;
+
+      // not null when the readout buffers are recorded
+      std::unique_ptr<RawRecorder> recorder;
     };
 
+    struct DecodeThread;
+
     struct ReadoutThread : ToolFramework::Thread_args {
       Digitizer& tool;
       std::vector<Board*> digitizers;
 
+      // Pipelined mode (readout_buffers > 1): this thread keeps the link busy
+      // reading data into free buffers of the boards, while `decoder` decodes
+      // the filled buffers
+      DecodeThread*           decoder = nullptr;
+      std::queue<Buffer*>     filled;
+      std::mutex              mutex; // protects filled and Board::free
+      std::condition_variable filled_cv;
+      std::condition_variable free_cv;
+
+      PollScheduler scheduler;
+
       ReadoutThread(Digitizer& tool): tool(tool) {};
     };
 
+    struct DecodeThread : ToolFramework::Thread_args {
+      ReadoutThread& link;
+
+      DecodeThread(ReadoutThread& link): link(link) {};
+    };
+
     struct MonitorThread : ToolFramework::Thread_args {
       Digitizer& tool;
       std::chrono::seconds interval;
@@ -41,22 +96,43 @@ class Digitizer: public ToolFramework::Tool {
     };
 
     ToolFramework::Utilities util;
-    std::vector<ReadoutThread> threads;
+    // std::list is used since the threads and the boards are referenced by
+    // pointers while being added
+    std::list<ReadoutThread> threads;
 
-    std::vector<Board> digitizers;
+    std::list<Board> digitizers;
     uint16_t nsamples; // number of samples in waveforms
 
+    // decode the readout buffer with CAENDigitizer library rather than with
+    // dpp_psd::decode
+    bool caen_decoder = false;
+
+    // number of readout buffers per board; the link is read and the data is
+    // decoded in separate threads when greater than 1
+    unsigned readout_buffers = 1;
+
     bool acquiring = false;
 
+    // set in Finalise to stop waiting for space in the raw readout queues
+    // and below the raw readout watermarks
+    std::atomic<bool> stopping {false};
+
     MonitorThread* monitor = nullptr;
 
     void connect();
+    DigitizerEmulator::Parameters emulator_parameters(int board);
     void configure();
     void run_readout();
     void run_monitor();
-    void readout(Board&);
+    void read(Buffer&);
+    void decode(Buffer&);
+    void decode_caen(Buffer&);
+    void push(Board&, std::unique_ptr<HitBlock>);
+    size_t readout(Board&);
+    size_t readout(ReadoutThread&, Board&);
 
     static void readout_thread(ToolFramework::Thread_args*);
+    static void decode_thread(ToolFramework::Thread_args*);
     static void monitor_thread(ToolFramework::Thread_args*);
 
     ToolFramework::Logging& log(int level) {
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cmath>
+
+#include "DigitizerEmulator.h"
+
+DigitizerEmulator::Parameters::Parameters() {
+  std::fill(rate, rate + nchannels, 1e3);
+}
+
+DigitizerEmulator::DigitizerEmulator(const Parameters& parameters):
+  parameters(parameters),
+  acquiring(false)
+{
+  // splitmix64 to expand the seed into the xorshift128+ state
+  uint64_t seed = parameters.seed;
+  for (auto& state : random_state) {
+    uint64_t z = (seed += 0x9e3779b97f4a7c15);
+    z = (z ^ z >> 30) * 0xbf58476d1ce4e5b9;
+    z = (z ^ z >> 27) * 0x94d049bb133111eb;
+    state = z ^ z >> 31;
+  };
+}
+
+uint64_t DigitizerEmulator::random() {
+  // xorshift128+
+  uint64_t s1 = random_state[0];
+  uint64_t s0 = random_state[1];
+  random_state[0] = s0;
+  s1 ^= s1 << 23;
+  random_state[1] = s1 ^ s0 ^ s1 >> 18 ^ s0 >> 5;
+  return random_state[1] + s0;
+}
+
+double DigitizerEmulator::uniform() {
+  return (static_cast<double>(random() >> 11) + 1) / 9007199254740992.0;
+}
+
+double DigitizerEmulator::exponential() {
+  return -std::log(uniform());
+}
+
+void DigitizerEmulator::configure(
+    uint16_t channel_mask,
+    uint16_t nsamples,
+    uint16_t pre_trigger_size,
+    bool     negative_polarity
+) {
+  for (uint32_t i = 0; i < nchannels; ++i) {
+    channels[i].enabled = channel_mask & 1 << i;
+    channels[i].rate    = parameters.rate[i];
+  };
+
+  nsamples = (nsamples + 7) & ~7;
+  this->nsamples = nsamples;
+  negative       = negative_polarity;
+
+  buffer_size
+    = dpp_psd::board_header_words
+    + nchannels / 2 * dpp_psd::channel_header_words
+    + nchannels * parameters.max_events * (3 + nsamples / 2);
+
+  // Fast rise followed by an exponential decay, normalized to the unit
+  // integral so that the waveform area follows the long gate charge
+  pulse.assign(nsamples, 0);
+  float sum = 0;
+  for (uint16_t i = pre_trigger_size; i < nsamples; ++i) {
+    uint16_t t = i - pre_trigger_size;
+    pulse[i] = t < 2 ? (t + 1) / 3.0f : std::exp(-(t - 2) / 10.0f);
+    sum += pulse[i];
+  };
+  if (sum > 0) for (auto& p : pulse) p /= sum;
+}
+
+void DigitizerEmulator::start() {
+  start_time = std::chrono::steady_clock::now();
+  now        = 0;
+  for (auto& channel : channels) {
+    double rate = channel.rate * std::max(1.0, parameters.burst_factor);
+    channel.next = rate > 0 ? exponential() / rate : HUGE_VAL;
+  };
+  acquiring = true;
+}
+
+void DigitizerEmulator::stop() {
+  acquiring = false;
+}
+
+double DigitizerEmulator::rate_factor(double time) const {
+  if (parameters.burst_period <= 0) return 1;
+  return std::fmod(time, parameters.burst_period) < parameters.burst_duration
+       ? parameters.burst_factor
+       : 1;
+}
+
+uint32_t DigitizerEmulator::generate(
+    uint32_t index, double time, std::vector<uint32_t>& buffer
+) {
+  Channel& channel = channels[index];
+  if (!channel.enabled) return 0;
+
+  // Thinning: candidates are drawn at the maximal rate and accepted with the
+  // probability equal to the ratio of the current rate to the maximal one
+  double max_factor = std::max(1.0, parameters.burst_factor);
+  double max_rate   = channel.rate * max_factor;
+  if (max_rate <= 0) return 0;
+
+  const double clock = 1 + parameters.drift * 1e-6;
+  const uint16_t base = negative ? 15000 : 1000;
+
+  uint32_t n = 0;
+  while (channel.next < time && n < parameters.max_events) {
+    double t = channel.next;
+    channel.next += exponential() / max_rate;
+
+    if (max_factor != 1 && uniform() * max_factor > rate_factor(t)) continue;
+
+    // Board timestamp: 2 ns coarse ticks and 1/1024 tick fine time. Bits 0 to
+    // 30 of the coarse time go into the trigger time tag, bits 31 to 46 go
+    // into Extras[31:16]; the fine time goes into Extras[9:0].
+    double ticks = (t * clock + parameters.offset) / 2e-9;
+    if (ticks < 0) ticks = 0;
+    uint64_t coarse = static_cast<uint64_t>(ticks);
+    uint32_t fine   = static_cast<uint32_t>((ticks - coarse) * 1024) & 0x3ff;
+
+    double charge = std::min(32767.0, parameters.charge * exponential());
+
+    buffer.push_back((index & 1) << 31 | (coarse & 0x7fffffff));
+
+    if (nsamples) {
+      float amplitude = negative ? -charge : charge;
+      for (uint16_t i = 0; i < nsamples; i += 2) {
+        uint32_t word = 0;
+        for (uint16_t j = 0; j < 2; ++j) {
+          int noise = static_cast<int>(random() & 7) - 3;
+          int sample = base + static_cast<int>(amplitude * pulse[i + j]) + noise;
+          word |= static_cast<uint32_t>(std::min(std::max(sample, 0), 0x3fff))
+               << j * 16;
+        };
+        buffer.push_back(word);
+      };
+    };
+
+    buffer.push_back((coarse >> 31 & 0xffff) << 16 | fine);
+
+    // gamma-like and neutron-like pulse shapes
+    uint32_t charge_long  = static_cast<uint32_t>(charge);
+    uint32_t charge_short = static_cast<uint32_t>(
+        charge * (uniform() < 0.2 ? 0.65 : 0.85)
+    );
+    buffer.push_back(charge_long << 16 | (charge_short & 0x7fff));
+
+    ++n;
+  };
+
+  return n;
+}
+
+void DigitizerEmulator::readData(std::vector<uint32_t>& buffer) {
+  buffer.clear();
+  buffer.reserve(buffer_size);
+  nevents = 0;
+
+  if (!acquiring) return;
+
+  if (parameters.realtime)
+    now = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start_time
+    ).count();
+  else
+    now += parameters.read_interval;
+
+  uint32_t format
+    = dpp_psd::format_charge
+    | dpp_psd::format_time
+    | dpp_psd::format_extras
+    | dpp_psd::format_extras_time;
+  if (nsamples) format |= dpp_psd::format_waveform | nsamples / 8;
+
+  buffer.resize(dpp_psd::board_header_words);
+  uint32_t couples = 0;
+  for (uint32_t couple = 0; couple < nchannels / 2; ++couple) {
+    size_t header = buffer.size();
+    buffer.resize(header + dpp_psd::channel_header_words);
+    uint32_t n = generate(couple * 2,     now, buffer)
+               + generate(couple * 2 + 1, now, buffer);
+    if (n == 0) {
+      buffer.resize(header);
+      continue;
+    };
+    buffer[header]     = 1u << 31 | (buffer.size() - header);
+    buffer[header + 1] = format;
+    couples |= 1 << couple;
+    nevents += n;
+  };
+
+  if (nevents == 0) {
+    buffer.clear();
+    return;
+  };
+
+  uint64_t ticks = static_cast<uint64_t>(now / 2e-9);
+  buffer[0] = dpp_psd::board_aggregate_tag << 28 | buffer.size();
+  buffer[1] = couples;
+  buffer[2] = aggregate++ & 0x7fffff;
+  buffer[3] = ticks & 0xffffffff;
+
+  total += nevents;
+}
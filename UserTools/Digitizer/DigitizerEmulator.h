@@ -0,0 +1,116 @@
+#ifndef DigitizerEmulator_H
+#define DigitizerEmulator_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "DPPPSD.h"
+
+// Software model of a CAEN digitizer running the DPP-PSD firmware. It produces
+// readout buffers in the DPP-PSD data format (see DPPPSD.h) so that the
+// Digitizer tool can be run and benchmarked without hardware.
+//
+// Events in each channel form a Poisson process with the rate optionally
+// modulated by a periodic burst pattern. Timestamps are generated by the board
+// clock which may drift with respect to the true time.
+class DigitizerEmulator {
+  public:
+    static const uint32_t nchannels = 16;
+
+    struct Parameters {
+      // mean event rate in each channel, Hz
+      double rate[nchannels];
+
+      // Burst pattern: during the first `burst_duration` seconds of every
+      // `burst_period` seconds the rate is multiplied by `burst_factor`.
+      // Disabled when `burst_period` is 0.
+      double burst_period   = 0;
+      double burst_duration = 0;
+      double burst_factor   = 1;
+
+      // board clock drift (ppm) and offset (seconds) relative to the true time
+      double drift  = 0;
+      double offset = 0;
+
+      // When true, events are generated up to the current wall clock time.
+      // Otherwise each readData call advances the emulated time by
+      // `read_interval` seconds regardless of the wall clock.
+      bool   realtime      = true;
+      double read_interval = 1e-3;
+
+      // maximum number of events per channel returned by a single readData
+      // call (the board aggregate size)
+      uint32_t max_events = 1023;
+
+      // mean of the (exponential) long gate charge spectrum
+      double charge = 1000;
+
+      uint64_t seed = 0;
+
+      Parameters();
+    };
+
+    DigitizerEmulator(const Parameters&);
+
+    // Mirrors the board configuration done by the Digitizer tool
+    void configure(
+        uint16_t channel_mask,
+        uint16_t nsamples,
+        uint16_t pre_trigger_size,
+        bool     negative_polarity
+    );
+
+    void start();
+    void stop();
+
+    // Generate the events accumulated since the last call and encode them
+    // into `buffer` (replacing its contents)
+    void readData(std::vector<uint32_t>& buffer);
+
+    // number of events in the last readout
+    uint32_t getNumEvents() const { return nevents; };
+
+    // total number of events generated since construction
+    uint64_t generated() const { return total; };
+
+  private:
+    struct Channel {
+      bool   enabled = false;
+      double rate    = 0;
+      double next    = 0; // true time of the next candidate event, seconds
+    };
+
+    Parameters parameters;
+    Channel    channels[nchannels];
+
+    uint16_t nsamples = 0; // rounded up to a multiple of 8 as by the board
+    bool     negative = false;
+    std::vector<float> pulse; // normalized pulse shape, nsamples long
+
+    size_t   buffer_size = 0; // maximal readout size, words
+    uint32_t nevents   = 0;
+    uint32_t aggregate = 0; // board aggregate counter
+
+    // set last in start() so that readData called from the readout thread
+    // sees the initialized state
+    std::atomic<bool> acquiring;
+    std::chrono::steady_clock::time_point start_time;
+    double now = 0; // emulated true time, seconds
+
+    uint64_t total = 0;
+
+    uint64_t random_state[2];
+
+    uint64_t random();
+    double   uniform();     // (0, 1]
+    double   exponential(); // mean 1
+
+    double   rate_factor(double time) const;
+    uint32_t generate(
+        uint32_t channel, double time, std::vector<uint32_t>& buffer
+    );
+};
+
+#endif
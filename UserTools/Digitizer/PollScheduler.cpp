@@ -0,0 +1,38 @@
+#include <algorithm>
+#include <thread>
+
+#include "PollScheduler.h"
+
+PollScheduler::PollScheduler():
+  min(10),
+  max(10000),
+  target(65536),
+  last(std::chrono::steady_clock::now()),
+  rate_(0),
+  interval_(0)
+{}
+
+void PollScheduler::wait(size_t bytes) {
+  if (max.count() <= 0) return;
+
+  auto now = std::chrono::steady_clock::now();
+  double dt = std::chrono::duration<double>(now - last).count();
+  last = now;
+
+  // exponentially weighted moving average of the data rate
+  double rate = rate_.load();
+  if (dt > 0) rate += 0.25 * (bytes / dt - rate);
+  rate_.store(rate);
+
+  double interval; // microseconds
+  if (bytes == 0)
+    interval = std::max<double>(1, interval_.load()) * 2;
+  else if (rate > 0)
+    interval = target / rate * 1e6;
+  else
+    interval = max.count();
+  interval = std::min<double>(std::max<double>(interval, min.count()), max.count());
+  interval_.store(static_cast<int64_t>(interval));
+
+  std::this_thread::sleep_for(std::chrono::microseconds(interval_.load()));
+}
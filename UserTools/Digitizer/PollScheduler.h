@@ -0,0 +1,39 @@
+#ifndef PollScheduler_H
+#define PollScheduler_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+// Adaptive poll interval of a readout link. The interval is chosen so that
+// each readout carries about `target` bytes given the measured data rate,
+// within [min, max]. `max` bounds the readout latency at low rate; at high
+// rate the interval goes down to `min`. When a readout brings no data, the
+// interval is doubled (up to `max`).
+class PollScheduler {
+  public:
+    std::chrono::microseconds min;
+    std::chrono::microseconds max;
+    size_t target; // bytes per readout
+
+    PollScheduler();
+
+    // Called after each readout with the number of bytes read. Sleeps until
+    // the next readout. Does not sleep when max is zero.
+    void wait(size_t bytes);
+
+    // current poll interval
+    std::chrono::microseconds interval() const {
+      return std::chrono::microseconds(interval_.load());
+    };
+
+    // estimated data rate, bytes per second
+    double rate() const { return rate_.load(); };
+
+  private:
+    std::chrono::steady_clock::time_point last;
+    std::atomic<double>  rate_;
+    std::atomic<int64_t> interval_; // microseconds
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "RawRecording.h"
+
+using namespace raw_recording;
+
+RawRecorder::RawRecorder(const std::string& path, uint8_t board):
+  // a few readouts per buffer at high rate
+  file(1 << 22, 4, false, AsyncFile::Sync::close, std::chrono::milliseconds(0)),
+  board(board)
+{
+  file.open(path);
+  FileHeader header;
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version  = version;
+  header.reserved = 0;
+  file.write(&header, sizeof(header));
+}
+
+RawRecorder::~RawRecorder() {
+  file.close();
+}
+
+void RawRecorder::record(const uint32_t* data, size_t size) {
+  FrameHeader header;
+  header.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+  header.board = board;
+  header.size  = size * sizeof(uint32_t);
+  file.write(&header, sizeof(header));
+  file.write(data, header.size);
+}
+
+RawReplay::RawReplay(const std::string& path, bool realtime):
+  file(path, std::ios::binary),
+  path(path),
+  realtime(realtime)
+{
+  if (!file) throw std::runtime_error("RawReplay: failed to open " + path);
+  FileHeader header;
+  if (
+      !file.read(reinterpret_cast<char*>(&header), sizeof(header))
+      || std::memcmp(header.magic, magic, sizeof(magic)) != 0
+  )
+    throw std::runtime_error("RawReplay: " + path + " is not a recording");
+  if (header.version != version)
+    throw std::runtime_error(
+        "RawReplay: " + path + " has unsupported version "
+        + std::to_string(header.version)
+    );
+  read_header();
+  if (truncated)
+    throw std::runtime_error("RawReplay: " + path + " is truncated");
+  if (!done) first_time = next.time;
+}
+
+void RawReplay::read_header() {
+  file.read(reinterpret_cast<char*>(&next), sizeof(next));
+  if (file.gcount() == 0 && file.eof()) {
+    done = true;
+    return;
+  };
+  if (!file || next.size % sizeof(uint32_t)) done = truncated = true;
+}
+
+void RawReplay::start() {
+  start_time = std::chrono::steady_clock::now();
+}
+
+void RawReplay::readData(std::vector<uint32_t>& buffer) {
+  buffer.clear();
+  if (done) {
+    if (truncated) {
+      // reported once
+      truncated = false;
+      throw std::runtime_error("RawReplay: " + path + " is truncated");
+    };
+    return;
+  };
+
+  if (
+      realtime
+      && std::chrono::steady_clock::now() - start_time
+         < std::chrono::nanoseconds(next.time - first_time)
+  )
+    return;
+
+  buffer.resize(next.size / sizeof(uint32_t));
+  if (!file.read(reinterpret_cast<char*>(buffer.data()), next.size)) {
+    buffer.clear();
+    done = true;
+    throw std::runtime_error("RawReplay: " + path + " is truncated");
+  };
+  ++nframes;
+  read_header();
+}
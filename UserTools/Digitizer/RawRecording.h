@@ -0,0 +1,98 @@
+#ifndef RawRecording_H
+#define RawRecording_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "AsyncFile.h"
+
+// Recording of the readout buffers of a board exactly as returned by
+// readData, before any decoding. Replaying a recording through the decoder
+// reproduces the acquisition without the hardware.
+//
+// file:  FileHeader, then a frame per readout: FrameHeader followed by
+//        `size` bytes of the readout buffer
+// All values are in the byte order of the recording machine (little endian).
+namespace raw_recording {
+  static const char     magic[8] = { 'B', 'U', 'T', 'T', 'O', 'N', 'R', 'W' };
+  static const uint32_t version  = 1;
+
+  struct FileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+  };
+
+  struct FrameHeader {
+    uint64_t time;  // of the readout, ns since the epoch
+    uint32_t board; // id of the board in the Digitizer configuration
+    uint32_t size;  // of the readout buffer, bytes
+  };
+};
+
+// Writes the readout buffers of a board to a recording. The buffers are
+// copied into the AsyncFile buffers, so that the readout thread does not
+// wait for the disk.
+class RawRecorder {
+  public:
+    // Throws std::runtime_error if the file cannot be opened
+    RawRecorder(const std::string& path, uint8_t board);
+    ~RawRecorder();
+
+    void record(const uint32_t* data, size_t size /* in words */);
+
+    // Writes the remaining data and closes the file. Returns false if any
+    // write failed (the buffers after the failure are not recorded).
+    bool close() { return file.close(); };
+
+    std::string error() const { return file.error(); };
+
+  private:
+    AsyncFile file;
+    uint8_t   board;
+};
+
+// Reads a recording made by RawRecorder, standing for a board in place of
+// the hardware.
+class RawReplay {
+  public:
+    // Throws std::runtime_error if the file cannot be opened or is not a
+    // recording. When `realtime` is true, the buffers are returned at the
+    // intervals at which they were recorded, otherwise as fast as they are
+    // requested.
+    RawReplay(const std::string& path, bool realtime);
+
+    void start();
+
+    // Replaces the contents of `buffer` with the next recorded buffer. Leaves
+    // `buffer` empty if the next buffer is not due yet or the recording is
+    // over. Throws std::runtime_error once if the recording is truncated
+    // (the buffers before the truncation are returned).
+    void readData(std::vector<uint32_t>& buffer);
+
+    bool finished() const { return done; };
+
+    // number of buffers returned by readData
+    uint64_t frames() const { return nframes; };
+
+  private:
+    std::ifstream file;
+    std::string   path;
+    bool          realtime;
+    bool          done = false;
+    bool          truncated = false; // the last frame header is incomplete
+    uint64_t      nframes = 0;
+
+    // header of the next frame, valid unless done
+    raw_recording::FrameHeader next;
+
+    uint64_t first_time = 0; // of the first frame
+    std::chrono::steady_clock::time_point start_time;
+
+    void read_header();
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include <algorithm>
+
+#include "DataModel.h"
+
+#include "EventBuilder.h"
+
+EventBuilder::EventBuilder(): Tool() {}
+
+// The triggers are in time order, so are the windows: an event is extended
+// while the next window starts before its end. The hits of an event are
+// found by binary search in the time ordered hits, starting from the end of
+// the previous event. The selected hits are moved to the front of
+// TimeSlice::hits (an event never starts before the previous one ends, so
+// no hit is overwritten before it is read), and their waveforms are copied
+// into `waveforms` in the order of the hits.
+void EventBuilder::build(
+    TimeSlice& timeslice, std::vector<uint16_t>& waveforms
+) {
+  std::vector<Hit>& hits = timeslice.hits;
+  const std::vector<TriggerRecord>& triggers = timeslice.positive_trggers;
+  auto window_start = [this](uint64_t time) -> uint64_t {
+    return time > pre_trigger ? time - pre_trigger : 0;
+  };
+  auto before = [](const Hit& hit, uint64_t time) { return hit.time < time; };
+
+  waveforms.clear();
+  timeslice.events.clear();
+  size_t nhits = hits.size();
+  size_t out   = 0;
+  auto   from  = hits.begin();
+  for (size_t i = 0; i < triggers.size();) {
+    Event event;
+    event.start    = window_start(triggers[i].time);
+    event.end      = event.start;
+    event.triggers = 0;
+    for (
+        ;
+        i < triggers.size() && window_start(triggers[i].time) <= event.end;
+        ++i
+    ) {
+      event.end = std::max(event.end, triggers[i].time + post_trigger);
+      event.triggers |= 1 << static_cast<unsigned>(triggers[i].type);
+    };
+
+    auto begin = std::lower_bound(from, hits.end(), event.start, before);
+    auto end   = std::lower_bound(begin, hits.end(), event.end, before);
+    from = end;
+
+    event.first_hit = out;
+    event.nhits     = end - begin;
+    for (auto h = begin; h != end; ++h) {
+      Hit hit = *h;
+      if (hit.waveform_length) {
+        const uint16_t* samples = timeslice.waveform(hit);
+        hit.waveform_offset = waveforms.size();
+        waveforms.insert(
+            waveforms.end(), samples, samples + hit.waveform_length
+        );
+      };
+      hits[out++] = hit;
+    };
+    timeslice.events.push_back(event);
+  };
+  hits.resize(out);
+  timeslice.waveforms.swap(waveforms);
+
+  ++timeslices;
+  events   += timeslice.events.size();
+  hits_in  += nhits;
+  hits_out += out;
+}
+
+void EventBuilder::ThreadArgs::report() {
+  auto now = std::chrono::steady_clock::now();
+  if (now < next_report) return;
+  next_report = now + tool.monitor_interval;
+
+  uint64_t hits_in  = tool.hits_in;
+  uint64_t hits_out = tool.hits_out;
+
+  Store data;
+  data.Set("event_builder_timeslices", tool.timeslices.load());
+  data.Set("event_builder_events",     tool.events.load());
+  data.Set("event_builder_hits_in",    hits_in);
+  data.Set("event_builder_hits_out",   hits_out);
+  // fraction of the hits kept
+  data.Set(
+      "event_builder_kept", hits_in ? double(hits_out) / hits_in : 0
+  );
+
+  std::string json;
+  data >> json;
+  tool.m_data->services->SendMonitoringData(std::move(json), "EventBuilder");
+}
+
+void EventBuilder::ThreadArgs::execute() {
+  if (tool.m_data->services) report();
+
+  std::unique_ptr<TimeSlice> timeslice;
+  {
+    std::unique_lock<std::mutex> lock(tool.m_data->event_queue_mutex);
+    auto& queue = tool.m_data->event_queue;
+    // return periodically to let the thread be stopped
+    if (
+        !tool.m_data->event_queue_cv.wait_for(
+          lock,
+          std::chrono::milliseconds(100),
+          [&queue]() { return !queue.empty(); }
+        )
+    )
+      return;
+    timeslice = std::move(queue.front());
+    queue.pop();
+  };
+
+  tool.build(*timeslice, waveforms);
+  tool.m_data->write_timeslice(std::move(timeslice));
+}
+
+void EventBuilder::Thread(Thread_args* args) {
+  static_cast<ThreadArgs*>(args)->execute();
+}
+
+bool EventBuilder::Initialise(std::string configfile, DataModel& data) {
+  InitialiseTool(data);
+  InitialiseConfiguration(configfile);
+
+  if (!m_variables.Get("verbose", m_verbose)) m_verbose = 1;
+
+  double ns = 1000;
+  m_variables.Get("pre_trigger", ns);
+  pre_trigger = Hit::time_from_ns(ns);
+
+  ns = 2000;
+  m_variables.Get("post_trigger", ns);
+  post_trigger = Hit::time_from_ns(ns);
+
+  int seconds = 5;
+  m_variables.Get("monitor_interval", seconds);
+  monitor_interval = std::chrono::seconds(seconds);
+
+  thread = new ThreadArgs(*this);
+  util.CreateThread("EventBuilder", &Thread, thread);
+  m_data->event_building = true;
+
+  ExportConfiguration();
+  return true;
+}
+
+bool EventBuilder::Execute() {
+  return true;
+}
+
+bool EventBuilder::Finalise() {
+  m_data->event_building = false;
+  util.KillThread(thread);
+
+  // build the timeslices left in the queue
+  std::lock_guard<std::mutex> lock(m_data->event_queue_mutex);
+  auto& queue = m_data->event_queue;
+  while (!queue.empty()) {
+    std::unique_ptr<TimeSlice> timeslice = std::move(queue.front());
+    queue.pop();
+    build(*timeslice, thread->waveforms);
+    m_data->write_timeslice(std::move(timeslice));
+  };
+
+  delete thread;
+  thread = nullptr;
+  return true;
+}
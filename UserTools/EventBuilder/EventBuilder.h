@@ -0,0 +1,65 @@
+#ifndef EventBuilder_H
+#define EventBuilder_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <iostream>
+#include <vector>
+
+#include "Tool.h"
+
+// Cuts the timeslices down to the hits around the triggers. Takes the
+// timeslices processed by all triggers from DataModel::event_queue, opens a
+// window [time - pre_trigger, time + post_trigger) around each trigger in
+// TimeSlice::positive_trggers, merges the overlapping windows into events
+// (TimeSlice::events) and drops the hits outside of the events. Windows are
+// clipped to the timeslice. The built timeslices are passed to the
+// DataWriter (DataModel::write_timeslice).
+class EventBuilder: public ToolFramework::Tool {
+  public:
+    EventBuilder();
+
+    bool Initialise(std::string configfile, DataModel& data);
+    bool Execute();
+    bool Finalise();
+
+  private:
+    struct ThreadArgs : Thread_args {
+      EventBuilder& tool;
+
+      // waveforms of the selected hits; swapped with TimeSlice::waveforms
+      std::vector<uint16_t> waveforms;
+
+      // next time to send the monitoring data
+      std::chrono::steady_clock::time_point next_report;
+
+      ThreadArgs(EventBuilder& tool):
+        tool(tool), next_report(std::chrono::steady_clock::now())
+      {};
+
+      void report();
+      void execute();
+    };
+
+    // in units of Hit::time
+    uint64_t pre_trigger;
+    uint64_t post_trigger;
+
+    std::chrono::seconds monitor_interval;
+
+    // counters
+    std::atomic<uint64_t> timeslices {0};
+    std::atomic<uint64_t> events     {0};
+    std::atomic<uint64_t> hits_in    {0};
+    std::atomic<uint64_t> hits_out   {0};
+
+    Utilities util;
+    ThreadArgs* thread = nullptr;
+
+    void build(TimeSlice& timeslice, std::vector<uint16_t>& waveforms);
+
+    static void Thread(Thread_args*);
+};
+
+#endif
@@ -12,5 +12,8 @@ if (tool=="DataWriter") ret=new DataWriter;
 if (tool=="HVoltage") ret=new HVoltage;
 if (tool=="Digitizer") ret=new Digitizer;
 if (tool=="Reformatter") ret=new Reformatter;
+if (tool=="EventBuilder") ret=new EventBuilder;
+if (tool=="CodecBenchmark") ret=new CodecBenchmark;
+if (tool=="HitReplay") ret=new HitReplay;
 return ret;
 }
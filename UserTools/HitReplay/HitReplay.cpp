@@ -0,0 +1,543 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "DataModel.h"
+#include "SliceReader.h"
+
+#include "HitReplay.h"
+
+HitReplay::HitReplay(): Tool() {}
+
+// Inverse of the decoding of the hit time in the Reformatter: the trigger
+// time tag (bits 0 to 30 of the coarse time) in the upper word, the extended
+// time (bits 31 to 46) and the fine time in the extras word
+inline static uint64_t encode_time(uint64_t time) {
+  uint64_t coarse = time >> 10;
+  uint32_t tag    = coarse & 0x7fffffff;
+  uint32_t extras = (coarse >> 31 & 0xffff) << 16 | (time & 0x3ff);
+  return static_cast<uint64_t>(tag) << 32 | extras;
+}
+
+bool HitReplay::Board::active(uint64_t readout) const {
+  uint64_t r = readout % (readouts.size() - 1);
+  return r < inactive_start || r >= inactive_end;
+}
+
+// Hits of `boards` boards with `channels` channels each, with Poisson
+// distributed times at `rate` Hz per channel during `duration` seconds. If
+// waveform_length is not zero, the hits get waveforms: a negative pulse on
+// top of the baseline.
+void HitReplay::generate() {
+  unsigned nboards = 4;
+  m_variables.Get("boards", nboards);
+  unsigned channels = 16;
+  m_variables.Get("channels", channels);
+  if (nboards == 0 || nboards > 16 || channels == 0 || channels > 16)
+    throw std::runtime_error(
+        "HitReplay: boards and channels must be in 1..16"
+    );
+  double rate = 10000;
+  m_variables.Get("rate", rate);
+  if (rate <= 0) throw std::runtime_error("HitReplay: rate must be positive");
+  double duration = 1;
+  m_variables.Get("duration", duration);
+  uint16_t waveform_length = 0;
+  m_variables.Get("waveform_length", waveform_length);
+  uint64_t seed = 0;
+  m_variables.Get("seed", seed);
+
+  std::mt19937_64 random(seed);
+  std::exponential_distribution<double> gap(rate);
+  std::normal_distribution<double> charge(400, 150);
+  std::uniform_int_distribution<int> noise(-2, 2);
+
+  boards.resize(nboards);
+  for (unsigned b = 0; b < nboards; ++b) {
+    Board& board = boards[b];
+    board.id = b;
+    for (unsigned c = 0; c < channels; ++c) {
+      uint16_t baseline = 14000 + noise(random) * 100;
+      for (double t = gap(random); t < duration; t += gap(random)) {
+        Hit hit;
+        hit.time            = Hit::time_from_ns(t * 1e9);
+        hit.channel         = c | b << 4;
+        hit.charge_long     = std::max(charge(random), 0.);
+        hit.charge_short    = hit.charge_long / 4;
+        hit.baseline        = baseline + noise(random);
+        hit.waveform_length = waveform_length;
+        hit.waveform_offset = board.waveforms.size();
+        double amplitude = hit.charge_long / 4.;
+        for (uint16_t j = 0; j < waveform_length; ++j) {
+          double t = (double(j) - waveform_length / 4) / 8;
+          double pulse = t > 0 ? amplitude * t * exp(1 - t) : 0;
+          board.waveforms.push_back(
+              std::max(hit.baseline - pulse + noise(random), 0.)
+          );
+        };
+        board.hits.push_back(hit);
+      };
+    };
+  };
+}
+
+// Hits of the data files written by the DataWriter, listed separated by
+// commas
+void HitReplay::load(const std::string& files) {
+  int index[16];
+  std::fill(index, index + 16, -1);
+
+  std::stringstream ss(files);
+  std::string path;
+  while (std::getline(ss, path, ',')) {
+    SliceReader reader(path);
+    for (size_t s : reader.find(0, UINT64_MAX)) {
+      SliceView slice = reader.slice(s);
+      ColumnView<uint64_t> time         = slice.time();
+      ColumnView<uint16_t> charge_short = slice.charge_short();
+      ColumnView<uint16_t> charge_long  = slice.charge_long();
+      ColumnView<uint16_t> baseline     = slice.baseline();
+      ColumnView<uint8_t>  channel      = slice.channel();
+      for (size_t i = 0; i < slice.nhits(); ++i) {
+        uint8_t id = Hit::get_digitizer_id(channel[i]);
+        if (index[id] < 0) {
+          index[id] = boards.size();
+          boards.emplace_back();
+          boards.back().id = id;
+        };
+        Board& board = boards[index[id]];
+
+        ColumnView<uint16_t> waveform = slice.waveform(i);
+        Hit hit;
+        hit.time            = time[i];
+        hit.channel         = channel[i];
+        hit.charge_short    = charge_short[i];
+        hit.charge_long     = charge_long[i];
+        hit.baseline        = baseline[i];
+        hit.waveform_length = waveform.size;
+        hit.waveform_offset = board.waveforms.size();
+        board.waveforms.insert(
+            board.waveforms.end(), waveform.begin(), waveform.end()
+        );
+        board.hits.push_back(hit);
+      };
+    };
+    log(1)
+      << "HitReplay: loaded " << reader.size() << " slices from " << path
+      << std::endl;
+  };
+
+  std::sort(
+      boards.begin(), boards.end(),
+      [](const Board& a, const Board& b) { return a.id < b.id; }
+  );
+}
+
+// Splits the hits of each board into readouts and reads the inactivity
+// periods of the boards
+void HitReplay::prepare() {
+  uint64_t first = UINT64_MAX;
+  uint64_t last  = 0;
+  for (auto& board : boards)
+    for (auto& hit : board.hits) {
+      first = std::min(first, hit.time);
+      last  = std::max(last,  hit.time);
+    };
+  if (first > last) throw std::runtime_error("HitReplay: no hits to replay");
+  start     = first - first % interval;
+  nreadouts = (last - start) / interval + 1;
+
+  for (auto& board : boards) {
+    // a readout brings the hits channel by channel, as the board sends its
+    // channel aggregates
+    uint64_t start    = this->start;
+    uint64_t interval = this->interval;
+    std::sort(
+        board.hits.begin(), board.hits.end(),
+        [start, interval](const Hit& a, const Hit& b) {
+          uint64_t ra = (a.time - start) / interval;
+          uint64_t rb = (b.time - start) / interval;
+          if (ra != rb) return ra < rb;
+          if (a.channel != b.channel) return a.channel < b.channel;
+          return a.time < b.time;
+        }
+    );
+
+    board.readouts.assign(nreadouts + 1, 0);
+    for (auto& hit : board.hits)
+      ++board.readouts[(hit.time - start) / interval + 1];
+    for (uint64_t r = 0; r < nreadouts; ++r)
+      board.readouts[r + 1] += board.readouts[r];
+
+    board.inactive_start = board.inactive_end = nreadouts;
+    std::string string;
+    if (
+        m_variables.Get(
+          "board_" + std::to_string(board.id) + "_inactive", string
+        )
+    ) {
+      std::stringstream ss(string);
+      std::string value;
+      double seconds[2] = { 0, HUGE_VAL };
+      for (int i = 0; i < 2 && std::getline(ss, value, ','); ++i)
+        seconds[i] = std::stod(value);
+      uint64_t readouts[2];
+      for (int i = 0; i < 2; ++i)
+        readouts[i] = std::min<double>(
+            std::ceil(seconds[i] * 1e9 / read_interval.count()), nreadouts
+        );
+      board.inactive_start = readouts[0];
+      board.inactive_end   = std::max(readouts[0], readouts[1]);
+    };
+  };
+}
+
+// Pushes the readouts [board.next, end) of the board into its raw readout
+// queue as one block, as a board which was not read out for a while returns
+// all its data at once
+void HitReplay::Producer::push(Board& board, uint64_t end) {
+  DataModel& data = *tool.m_data;
+  std::unique_ptr<HitBlock> block = data.hit_blocks.get();
+  uint64_t last = 0; // largest hit time in the block
+  for (uint64_t r = board.next; r < end; ++r) {
+    if (!board.active(r)) continue;
+    uint64_t readout = r % tool.nreadouts;
+    uint64_t offset  = (r - readout) * tool.interval; // of the loop
+    for (size_t i = board.readouts[readout]; i < board.readouts[readout + 1]; ++i) {
+      Hit hit = board.hits[i];
+      last = std::max(last, hit.time + offset);
+      hit.time     = encode_time(hit.time + offset);
+      hit.baseline = hit.baseline * 4; // see decode_baseline in Reformatter
+      block->push_back(hit, board.waveforms.data() + hit.waveform_offset);
+    };
+  };
+  board.next = end;
+
+  // the board status changes between its blocks
+  bool active = board.active(end - 1);
+  if (active) data.active_digitizers[board.id] = 1;
+
+  if (!block->hits.empty()) {
+    size_t nhits = block->hits.size();
+    // the replay should be reproducible, so the data is never dropped
+    QueueLimit& limit = data.raw_readout_limit;
+    while (limit.full() && !tool.stopping)
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    limit.add(*block);
+    while (!board.queue->push(block)) {
+      if (tool.stopping) {
+        limit.remove(*block);
+        break;
+      };
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    };
+    if (!block) {
+      tool.hits += nhits;
+      ++tool.blocks;
+      if (last > tool.last_pushed) tool.last_pushed = last;
+    };
+  };
+  if (block) {
+    block->clear();
+    data.hit_blocks.put(std::move(block));
+  };
+
+  if (!active) data.active_digitizers[board.id] = 0;
+}
+
+void HitReplay::Producer::report() {
+  auto now = std::chrono::steady_clock::now();
+  if (now < next_report) return;
+  double seconds = std::chrono::duration<double>(
+      now - next_report + tool.monitor_interval
+  ).count();
+  next_report = now + tool.monitor_interval;
+
+  uint64_t hits = tool.hits;
+  Store data;
+  data.Set("replay_hits",   hits);
+  data.Set("replay_blocks", tool.blocks.load());
+  data.Set("replay_rate",   (hits - last_hits) / seconds);
+  last_hits = hits;
+  if (tool.consumer) {
+    uint64_t timeslices = tool.timeslices;
+    data.Set("replay_timeslices", timeslices);
+    data.Set(
+        "replay_latency_mean",
+        timeslices ? tool.latency_sum * 1e-9 / timeslices : 0.
+    );
+    data.Set("replay_latency_max", tool.latency_max * 1e-9);
+  };
+
+  std::string json;
+  data >> json;
+  tool.m_data->services->SendMonitoringData(std::move(json), "HitReplay");
+}
+
+// Does one readout step: each board pushes its readouts up to the current
+// one less its random lag
+void HitReplay::Producer::execute() {
+  if (tool.m_data->services) report();
+
+  if (tool.finished) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return;
+  };
+
+  if (tool.realtime)
+    std::this_thread::sleep_until(start + step * tool.read_interval);
+
+  uint64_t total = tool.loops ? tool.loops * tool.nreadouts : UINT64_MAX;
+  uint64_t done  = total;
+  for (auto& board : tool.boards) {
+    uint64_t lag = tool.skew ? random() % (tool.skew + 1) : 0;
+    uint64_t end = std::min(step + 1 > lag ? step + 1 - lag : 0, total);
+    if (end > board.next) push(board, end);
+    if (tool.stopping) return;
+    done = std::min(done, board.next);
+  };
+  ++step;
+
+  auto now = std::chrono::steady_clock::now();
+  if (tool.consumer && done > completed) {
+    std::lock_guard<std::mutex> lock(tool.latency_mutex);
+    for (; completed < done; ++completed)
+      tool.pushed.emplace_back(
+          tool.start + (completed + 1) * tool.interval, now
+      );
+  } else
+    completed = done;
+
+  if (done == total) {
+    tool.finish_time = now;
+    tool.finished    = true;
+    for (auto& board : tool.boards)
+      tool.m_data->active_digitizers[board.id] = 0;
+    tool.log(1) << "HitReplay: replay finished" << std::endl;
+  };
+}
+
+// Takes the timeslices made by the Reformatter (in place of the Sorter). The
+// latency of a timeslice is the time since the readout of its last hit was
+// pushed by all boards.
+void HitReplay::Consumer::execute() {
+  DataModel& data = *tool.m_data;
+  std::unique_ptr<TimeSlice> timeslice;
+  {
+    std::unique_lock<std::mutex> lock(data.pre_sort_mutex);
+    auto& queue = data.pre_sort_queue;
+    if (
+        !data.pre_sort_cv.wait_for(
+          lock,
+          std::chrono::milliseconds(100),
+          [&queue]() { return !queue.empty(); }
+        )
+    )
+      return;
+    timeslice = std::move(queue.front());
+    queue.pop();
+  };
+  data.pre_sort_limit.remove(*timeslice);
+
+  if (!timeslice->hits.empty()) {
+    uint64_t last = timeslice->hits.back().time;
+    auto now = std::chrono::steady_clock::now();
+    bool found = false;
+    std::chrono::steady_clock::time_point pushed;
+    {
+      std::lock_guard<std::mutex> lock(tool.latency_mutex);
+      auto& readouts = tool.pushed;
+      while (!readouts.empty() && readouts.front().first <= last)
+        readouts.pop_front();
+      if (last > tool.last_seen) {
+        tool.last_seen = last;
+        tool.seen_time = now;
+      };
+      if (!readouts.empty()) {
+        found  = true;
+        pushed = readouts.front().second;
+      };
+    };
+    if (found) {
+      uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          now - pushed
+      ).count();
+      tool.latency_sum += latency;
+      if (latency > tool.latency_max) tool.latency_max = latency;
+      ++tool.timeslices;
+    };
+  };
+
+  timeslice->clear();
+  data.timeslices.put(std::move(timeslice));
+}
+
+void HitReplay::produce_thread(Thread_args* args) {
+  static_cast<Producer*>(args)->execute();
+}
+
+void HitReplay::consume_thread(Thread_args* args) {
+  static_cast<Consumer*>(args)->execute();
+}
+
+void HitReplay::summary() {
+  auto end = finished ? finish_time : std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - producer->start).count();
+  auto& log = this->log(0);
+  log
+    << "HitReplay: " << hits << " hits in " << blocks << " blocks, "
+    << seconds << " s, " << hits / seconds * 1e-6 << " Mhit/s";
+  if (consumer && timeslices)
+    log
+      << ", " << timeslices << " timeslices, latency mean "
+      << latency_sum * 1e-6 / timeslices << " ms, max "
+      << latency_max * 1e-6 << " ms";
+  log << std::endl;
+}
+
+bool HitReplay::Initialise(std::string configfile, DataModel& data) {
+  InitialiseTool(data);
+  InitialiseConfiguration(configfile);
+
+  if (!m_variables.Get("verbose", m_verbose)) m_verbose = 1;
+
+  double seconds = 1e-3;
+  m_variables.Get("read_interval", seconds);
+  interval      = Hit::time_from_ns(seconds * 1e9);
+  read_interval = std::chrono::nanoseconds(
+      static_cast<int64_t>(seconds * 1e9)
+  );
+  if (interval == 0)
+    throw std::runtime_error("HitReplay: read_interval is too small");
+
+  loops = 1;
+  m_variables.Get("loops", loops);
+  skew = 2;
+  m_variables.Get("skew", skew);
+  realtime = false;
+  m_variables.Get("realtime", realtime);
+
+  int monitor = 5;
+  m_variables.Get("monitor_interval", monitor);
+  monitor_interval = std::chrono::seconds(monitor);
+  int wait = 10;
+  m_variables.Get("timeout", wait);
+  timeout = std::chrono::seconds(wait);
+
+  boards.clear();
+  std::string files;
+  if (m_variables.Get("files", files))
+    load(files);
+  else
+    generate();
+  prepare();
+
+  size_t links = boards.size();
+  m_variables.Get("links", links);
+  if (links == 0) links = 1;
+  size_t queue = 1024;
+  m_variables.Get("raw_readout_queue", queue);
+  std::vector<RawReadout::Queue*> queues;
+  for (size_t i = 0; i < boards.size(); ++i) {
+    if (i < links) queues.push_back(m_data->raw_readout.add(queue));
+    boards[i].queue = queues[i % links];
+  };
+
+  QueueLimit& limit = m_data->raw_readout_limit;
+  limit.max_bytes = 1ul << 30;
+  m_variables.Get("raw_readout_max_hits",  limit.max_hits);
+  m_variables.Get("raw_readout_max_bytes", limit.max_bytes);
+
+  if (m_data->active_digitizers.size() <= boards.back().id)
+    m_data->active_digitizers.resize(boards.back().id + 1, 0);
+  for (auto& board : boards) m_data->active_digitizers[board.id] = 1;
+
+  hits        = 0;
+  blocks      = 0;
+  timeslices  = 0;
+  latency_sum = 0;
+  latency_max = 0;
+  last_pushed = 0;
+  last_seen   = 0;
+  finished   = false;
+  stopping   = false;
+  summarized = false;
+
+  bool consume = false;
+  m_variables.Get("consume", consume);
+  if (consume) {
+    consumer = new Consumer(*this);
+    util.CreateThread("HitReplay consumer", &consume_thread, consumer);
+  };
+
+  uint64_t seed = 0;
+  m_variables.Get("seed", seed);
+  producer = new Producer(*this, seed);
+  producer->start = std::chrono::steady_clock::now();
+  producer->next_report = producer->start + monitor_interval;
+  util.CreateThread("HitReplay", &produce_thread, producer);
+
+  log(1)
+    << "HitReplay: " << boards.size() << " boards, " << nreadouts
+    << " readouts per loop" << std::endl;
+
+  ExportConfiguration();
+  return true;
+}
+
+bool HitReplay::Execute() {
+  // With a finite number of loops, wait for the replay, so that a toolchain
+  // run with Inline 1 ends with it. With the consumer, the replay ends when
+  // the timeslice with the last hit leaves the Reformatter. The wait ends
+  // early when neither the replay nor the consumer moves for `timeout`, as
+  // when the last timeslice is dropped or spilled.
+  if (loops && !summarized) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    uint64_t progress = 0;
+    while (true) {
+      uint64_t moved;
+      {
+        std::lock_guard<std::mutex> lock(latency_mutex);
+        if (finished && (!consumer || last_seen >= last_pushed)) {
+          if (consumer && last_pushed) finish_time = seen_time;
+          break;
+        };
+        moved = hits + last_seen;
+      };
+      auto now = std::chrono::steady_clock::now();
+      if (moved != progress) {
+        progress = moved;
+        deadline = now + timeout;
+      } else if (now >= deadline) {
+        log(0)
+          << "HitReplay: no progress for " << timeout.count()
+          << " s, " << (finished ? "the last hits did not come out of the "
+                                   "Reformatter" : "the replay is stuck")
+          << std::endl;
+        break;
+      };
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    };
+    summary();
+    summarized = true;
+  };
+  return true;
+}
+
+bool HitReplay::Finalise() {
+  stopping = true;
+  util.KillThread(producer);
+  if (consumer) util.KillThread(consumer);
+  if (!summarized) summary();
+  delete producer;
+  producer = nullptr;
+  delete consumer;
+  consumer = nullptr;
+
+  for (auto& board : boards) m_data->active_digitizers[board.id] = 0;
+  boards.clear();
+  pushed.clear();
+  return true;
+}
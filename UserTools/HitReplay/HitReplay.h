@@ -0,0 +1,137 @@
+#ifndef HitReplay_H
+#define HitReplay_H
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <iostream>
+#include <vector>
+
+#include "Tool.h"
+
+// Feeds the Reformatter with hits from data files written by the DataWriter
+// or with generated hits, in place of the Digitizer. The hits are pushed
+// into raw_readout in the data format of the Digitizer, a block per board
+// readout with the hits grouped by channel, through a queue per link. The
+// boards lag behind each other by a random number of readouts and can go
+// inactive for a time (see DataModel::active_digitizers), so that the
+// Reformatter sees the interleaving of a real acquisition, reproducibly.
+// With `consume`, the tool also takes the timeslices from the Reformatter
+// and measures their latency. Run with configfiles/replay.
+class HitReplay: public ToolFramework::Tool {
+  public:
+    HitReplay();
+
+    bool Initialise(std::string configfile, DataModel& data);
+    bool Execute();
+    bool Finalise();
+
+  private:
+    struct Board {
+      uint8_t id;
+
+      // Hits in the order of the readouts, and by channel and time within a
+      // readout, with decoded times. Waveform offsets are in `waveforms`.
+      std::vector<Hit>      hits;
+      std::vector<uint16_t> waveforms;
+
+      // index of the first hit of each readout, and the number of hits
+      std::vector<size_t> readouts;
+
+      // readouts [inactive_start, inactive_end) of each loop bring no data
+      // and the board is marked as inactive
+      uint64_t inactive_start = 0;
+      uint64_t inactive_end   = 0;
+
+      RawReadout::Queue* queue = nullptr;
+
+      // next readout to push, counting over the loops
+      uint64_t next = 0;
+
+      bool active(uint64_t readout) const;
+    };
+
+    struct Producer : Thread_args {
+      HitReplay& tool;
+      std::mt19937_64 random;
+      uint64_t step = 0; // readouts done by the fastest board
+      uint64_t completed = 0; // readouts done by all boards
+      std::chrono::steady_clock::time_point start;
+
+      // next time to send the monitoring data, and the hits pushed then
+      std::chrono::steady_clock::time_point next_report;
+      uint64_t last_hits = 0;
+
+      Producer(HitReplay& tool, uint64_t seed): tool(tool), random(seed) {};
+
+      void push(Board& board, uint64_t end);
+      void report();
+      void execute();
+    };
+
+    struct Consumer : Thread_args {
+      HitReplay& tool;
+
+      Consumer(HitReplay& tool): tool(tool) {};
+
+      void execute();
+    };
+
+    std::vector<Board> boards;
+
+    uint64_t interval;  // of a readout, in units of Hit::time
+    uint64_t start;     // of the first readout
+    uint64_t nreadouts; // in a loop
+    unsigned loops;     // 0 is forever
+    unsigned skew;      // maximal lag of a board, readouts
+    bool     realtime;
+    std::chrono::nanoseconds read_interval;
+    std::chrono::seconds monitor_interval;
+    std::chrono::seconds timeout; // of the wait in Execute without progress
+
+    // Completed readouts: the end of the readout (in units of Hit::time) and
+    // when the last board pushed it. Used to measure the latency of the
+    // timeslices.
+    std::mutex latency_mutex;
+    std::deque<std::pair<uint64_t, std::chrono::steady_clock::time_point>>
+      pushed;
+
+    std::atomic<bool>     finished {false};
+    std::atomic<bool>     stopping {false};
+    std::atomic<uint64_t> hits     {0};
+    std::atomic<uint64_t> blocks   {0};
+    std::chrono::steady_clock::time_point finish_time;
+    bool summarized = false;
+
+    // Largest hit time pushed, and the largest hit time seen by the
+    // consumer with when it was seen (under latency_mutex). The replay is
+    // over when the consumer has seen the last hit pushed.
+    std::atomic<uint64_t> last_pushed {0};
+    uint64_t last_seen = 0;
+    std::chrono::steady_clock::time_point seen_time;
+
+    std::atomic<uint64_t> timeslices  {0};
+    std::atomic<uint64_t> latency_sum {0}; // ns
+    std::atomic<uint64_t> latency_max {0}; // ns
+
+    Utilities util;
+    Producer* producer = nullptr;
+    Consumer* consumer = nullptr;
+
+    void generate();
+    void load(const std::string& files);
+    void prepare();
+    void summary();
+
+    static void produce_thread(Thread_args*);
+    static void consume_thread(Thread_args*);
+
+    ToolFramework::Logging& log(int level) {
+      return *m_log << ToolFramework::MsgL(level, m_verbose);
+    };
+};
+
+#endif
@@ -1,108 +1,131 @@
-#include "NhitsTrigger.h"
+#include <stdexcept>
 
-NhitsTrigger_args::NhitsTrigger_args():Thread_args(){}
+#include "DataModel.h"
 
-NhitsTrigger_args::~NhitsTrigger_args(){}
+#include "NhitsTrigger.h"
 
+NhitsTrigger::NhitsTrigger(): Tool() {}
+
+// Sliding window over the time ordered hits: `begin` and `end` bound the
+// hits within `window` before the hit at `end`. The trigger fires when the
+// window holds `threshold` hits and the previous trigger is older than
+// `dead_time`; the trigger time is the time of the first hit in the window.
+// Each hit enters and leaves the window once.
+void NhitsTrigger::process(TimeSlice& timeslice) {
+  auto start = std::chrono::steady_clock::now();
+
+  const std::vector<Hit>& hits = timeslice.hits;
+  // this trigger's lane; no other thread writes it
+  std::vector<uint64_t>& triggers = timeslice.lane(trigger_type::nhits);
+  size_t   begin = 0;
+  uint64_t live  = 0; // end of the dead time
+  for (size_t end = 0; end < hits.size(); ++end) {
+    uint64_t time = hits[end].time;
+    while (hits[begin].time + window <= time) ++begin;
+    if (end - begin + 1 >= threshold && time >= live) {
+      triggers.push_back(hits[begin].time);
+      live = time + dead_time;
+    };
+  };
+
+  ntriggers += triggers.size();
+  uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start
+  ).count();
+  uint64_t max = max_time;
+  while (time > max && !max_time.compare_exchange_weak(max, time));
+}
 
-NhitsTrigger::NhitsTrigger():Tool(){}
+void NhitsTrigger::ThreadArgs::report() {
+  auto now = std::chrono::steady_clock::now();
+  if (now < next_report) return;
+  next_report = now + tool.monitor_interval;
+
+  Store data;
+  tool.jobs->stats.report(data, "nhits_jobs");
+  data.Set("nhits_triggers", tool.ntriggers.load());
+
+  // slice evaluation time since the last report
+  uint64_t jobs = tool.jobs->stats.jobs;
+  uint64_t time = tool.jobs->stats.run_time;
+  data.Set(
+      "nhits_slice_time",
+      jobs > last_jobs ? (time - last_time) * 1e-9 / (jobs - last_jobs) : 0
+  );
+  data.Set("nhits_slice_time_max", tool.max_time.exchange(0) * 1e-9);
+  last_jobs = jobs;
+  last_time = time;
+
+  std::string json;
+  data >> json;
+  tool.m_data->services->SendMonitoringData(std::move(json), "NhitsTrigger");
+}
 
+void NhitsTrigger::ThreadArgs::execute() {
+  if (tool.m_data->services) report();
+  tool.jobs->dispatch(std::chrono::milliseconds(100));
+}
+
+void NhitsTrigger::Thread(Thread_args* args) {
+  static_cast<ThreadArgs*>(args)->execute();
+}
 
-bool NhitsTrigger::Initialise(std::string configfile, DataModel &data){
+bool NhitsTrigger::Initialise(std::string configfile, DataModel& data) {
   InitialiseTool(data);
   InitialiseConfiguration(configfile);
 
-  if(!m_variables.Get("verbose",m_verbose)) m_verbose=1;
+  if (!m_variables.Get("verbose", m_verbose)) m_verbose = 1;
 
-  m_util=new Utilities();
+  unsigned executor_threads = 0;
+  m_variables.Get("executor_threads", executor_threads);
+  m_data->executor.start(executor_threads);
 
-  m_threadnum=0;
-  CreateThread();
-  
-  m_freethreads=1;
+  unsigned max_jobs = m_data->executor.size();
+  m_variables.Get("max_jobs", max_jobs);
 
-  ExportConfiguration();
-  return true;
-}
+  double ns = 200;
+  m_variables.Get("window", ns);
+  window = Hit::time_from_ns(ns);
+  if (window == 0)
+    throw std::runtime_error("NhitsTrigger: window is too small");
 
+  threshold = 10;
+  m_variables.Get("threshold", threshold);
+  if (threshold == 0)
+    throw std::runtime_error("NhitsTrigger: threshold must be positive");
 
-bool NhitsTrigger::Execute(){
-
-  for(unsigned int i=0; i<args.size(); i++){
-    if(args.at(i)->busy==0){
-      std::cout<<"reply="<<args.at(i)->message<<std::endl;
-      args.at(i)->message="Hi";
-      args.at(i)->busy=1;
-      break;
-    }
-
-  }
-
-  m_freethreads=0;
-  int lastfree=0;
-  for(unsigned int i=0; i<args.size(); i++){
-    if(args.at(i)->busy==0){
-      m_freethreads++;
-      lastfree=i; 
-    }
-  }
-
-  if(m_freethreads<1) CreateThread();
-  if(m_freethreads>1) DeleteThread(lastfree);
-  
-  std::cout<<"free threads="<<m_freethreads<<":"<<args.size()<<std::endl;
-  
-  sleep(1);
-  
-  return true;
-}
+  double dead_ns = ns;
+  m_variables.Get("dead_time", dead_ns);
+  dead_time = Hit::time_from_ns(dead_ns);
 
+  int seconds = 5;
+  m_variables.Get("monitor_interval", seconds);
+  monitor_interval = std::chrono::seconds(seconds);
 
-bool NhitsTrigger::Finalise(){
+  jobs.reset(
+      new TriggerJobs(
+        *m_data,
+        trigger_type::nhits,
+        [this](TimeSlice& timeslice) { process(timeslice); },
+        max_jobs
+      )
+  );
 
-  for(unsigned int i=0;i<args.size();i++) m_util->KillThread(args.at(i));
-  
-  args.clear();
-  
-  delete m_util;
-  m_util=0;
+  thread = new ThreadArgs(*this);
+  util.CreateThread("NhitsTrigger", &Thread, thread);
 
+  ExportConfiguration();
   return true;
 }
 
-void NhitsTrigger::CreateThread(){
-
-  NhitsTrigger_args* tmparg=new NhitsTrigger_args();
-  tmparg->busy=0;
-  tmparg->message="";
-  args.push_back(tmparg);
-  std::stringstream tmp;
-  tmp<<"T"<<m_threadnum;
-  m_util->CreateThread(tmp.str(), &Thread, args.at(args.size()-1));
-  m_threadnum++;
-
+bool NhitsTrigger::Execute() {
+  return true;
 }
 
- void NhitsTrigger::DeleteThread(int pos){
-
-   m_util->KillThread(args.at(pos));
-   delete args.at(pos);
-   args.at(pos)=0;
-   args.erase(args.begin()+(pos-1));
-
- }
-
-void NhitsTrigger::Thread(Thread_args* arg){
-
-  NhitsTrigger_args* args=reinterpret_cast<NhitsTrigger_args*>(arg);
-
-  if(!args->busy) usleep(100);
-  else{ 
-
-    args->message="Hello";
-    sleep(10);
-
-    args->busy=0;
-  }
-
+bool NhitsTrigger::Finalise() {
+  util.KillThread(thread);
+  delete thread;
+  thread = nullptr;
+  jobs.reset(); // waits for the jobs in flight
+  return true;
 }
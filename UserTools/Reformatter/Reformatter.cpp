@@ -1,3 +1,7 @@
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
 #include "DataModel.h"
 #include "TimeSlice.h"
 
@@ -47,113 +51,167 @@ inline static uint16_t decode_baseline(uint16_t baseline) {
 #endif
 }
 
-void Reformatter::ThreadArgs::send(const std::vector<Hit>& hits) {
-  std::unique_ptr<TimeSlice> timeslice(new TimeSlice);
-  timeslice->hits = hits;
-  std::lock_guard<std::mutex> lock(tool.m_data->readout_mutex);
-  tool.m_data->readout.push(std::move(timeslice));
+// Moves the hits into a timeslice. The buffers are swapped rather than
+// copied; `hits` gets the (empty) buffers of a recycled timeslice.
+void Reformatter::ThreadArgs::send(HitBlock& hits) {
+  QueueLimit& limit = tool.m_data->pre_sort_limit;
+  while (limit.full()) {
+    if (limit.policy != QueueLimit::Policy::block) {
+      limit.discard(hits);
+      return;
+    };
+    // on stop, let the last hits through
+    if (tool.stopping) break;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  };
+
+  std::unique_ptr<TimeSlice> timeslice = tool.m_data->timeslices.get();
+  timeslice->hits.swap(hits.hits);
+  timeslice->waveforms.swap(hits.waveforms);
+  limit.add(*timeslice);
+  {
+    std::lock_guard<std::mutex> lock(tool.m_data->pre_sort_mutex);
+    tool.m_data->pre_sort_queue.push(std::move(timeslice));
+  };
+  tool.m_data->pre_sort_cv.notify_one();
 }
 
-void Reformatter::ThreadArgs::execute() {
-  if (!tool.m_data->raw_readout) return;
-
-  /* We wait until the time of the earlist hit available for processing across
-   * all channels (`time_min`) plus the desired timeslice length (`interval`)
-   * is less than the time of the latest hit in the channel for all active
-   * channels. A channel is active if we have seen data from it and its
-   * digitizer is active (see DataModel::active_digitizers and the Digitizer
-   * tool; basically a digitizer is active if it is responding). When we have
-   * all the hits we need, they are extracted from `readouts` and separated
-   * into `current` and `next` with `current` storing the hits fitting the time
-   * window, and `next` storing the hits to be send next. `current` data is
-   * then sent for processing.
-   */
+void Reformatter::ThreadArgs::report() {
+  auto now = std::chrono::steady_clock::now();
+  if (now < next_report) return;
+  next_report = now + tool.monitor_interval;
 
+  Store data;
   {
-    std::lock_guard<std::mutex> lock(tool.m_data->raw_readout_mutex);
-    readouts.push_back(std::move(tool.m_data->raw_readout));
+    std::lock_guard<std::mutex> lock(tool.m_data->pre_sort_mutex);
+    data.Set("pre_sort_timeslices", tool.m_data->pre_sort_queue.size());
   };
+  tool.m_data->pre_sort_limit.report(data, "pre_sort");
 
-  for (auto& board : *readouts.back())
-    for (auto& hit : *board) {
-      // Decode CAEN data format
-      hit.time     = decode_time(hit.time);
-      hit.baseline = decode_baseline(hit.baseline);
-
-      if (hit.channel >= channels.size()) {
-        // A new channel is seen. Initialize the `digitizer_active` fields
-        auto i = channels.size();
-        channels.resize(hit.channel + 1);
-        for (; i < channels.size(); ++i)
-          channels[i].digitizer_active
-            = &tool.m_data->active_digitizers[Hit::get_digitizer_id(i)];
-      };
+  std::string json;
+  data >> json;
+  tool.m_data->services->SendMonitoringData(std::move(json), "Reformatter");
+}
+
+// Returns the pending window for a hit at `time`, creating the windows up to
+// it as necessary
+HitBlock& Reformatter::ThreadArgs::window(uint64_t time) {
+  if (!started) {
+    start   = time - time % tool.interval;
+    started = true;
+  };
 
-      Channel& channel = channels[hit.channel];
-      if (channel.active) {
-        if (hit.time < channel.min)
-          channel.min = hit.time;
-        else if (hit.time > channel.max)
+  // hits late for an already sent window go to the first pending one
+  uint64_t index = time < start ? 0 : (time - start) / tool.interval;
+  // guard against a corrupted time stamp creating a huge number of windows
+  if (index >= max_windows) index = max_windows - 1;
+
+  while (windows.size() <= index) windows.push_back(tool.m_data->hit_blocks.get());
+  return *windows[index];
+}
+
+void Reformatter::ThreadArgs::execute() {
+  if (tool.m_data->services) report();
+
+  /* Timeslices are consecutive windows of length `interval`. Each hit is put
+   * into its window as soon as it is read, so a hit is copied once regardless
+   * of how far ahead of the other channels its channel runs. The first
+   * pending window is sent when for all active channels the latest hit time
+   * (`Channel::max`) is past the window end. A channel is active if we have
+   * seen data from it and its digitizer is active (see
+   * DataModel::active_digitizers and the Digitizer tool; basically a
+   * digitizer is active if it is responding).
+   */
+
+  // Take the available hit blocks from all readout queues
+  RawReadout& raw_readout = tool.m_data->raw_readout;
+  std::unique_ptr<HitBlock> block;
+  bool received = false;
+  for (size_t q = 0; q < raw_readout.size(); ++q)
+    while (raw_readout[q].pop(block)) {
+      received = true;
+      for (auto& hit : block->hits) {
+        // Decode CAEN data format
+        hit.time     = decode_time(hit.time);
+        hit.baseline = decode_baseline(hit.baseline);
+
+        if (hit.channel >= channels.size()) {
+          // A new channel is seen. Initialize the `digitizer_active` fields
+          auto i = channels.size();
+          channels.resize(hit.channel + 1);
+          for (; i < channels.size(); ++i)
+            channels[i].digitizer_active
+              = &tool.m_data->active_digitizers[Hit::get_digitizer_id(i)];
+        };
+
+        Channel& channel = channels[hit.channel];
+        if (!channel.active) {
+          channel.active = true;
+          channel.max    = hit.time;
+        } else if (hit.time > channel.max)
           channel.max = hit.time;
-      } else {
-        channel.active = true;
-        channel.min = channel.max = hit.time;
+
+        window(hit.time).push_back(hit, block->waveform(hit));
       };
-    };
 
-  for (auto& channel : channels)
-    if (channel.active) {
-      if (channel.min < time_min)
-        time_min = channel.min;
-      else if (channel.max > time_max)
-        time_max = channel.max;
+      // The hits are accounted in raw_readout_limit until their window is
+      // sent (see below), so the block is returned as is
+      block->clear();
+      tool.m_data->hit_blocks.put(std::move(block));
     };
+  if (!received) {
+    // Without new data, only a digitizer going inactive (such as a finished
+    // replay) can release the pending windows
+    bool stopped = false;
+    for (auto& channel : channels)
+      if (channel.active && !*channel.digitizer_active) {
+        stopped = true;
+        break;
+      };
+    if (!stopped) return;
+  };
 
-  // check the time window
-  uint64_t end = time_min + tool.interval;
-  for (auto& channel : channels)
-    if (channel.active && channel.max < end)
-      if (*channel.digitizer_active)
-        // some channel may yet provide data fitting the current time window
-        return;
-      else
-        // channel's digitizer went inactive
-        channel.active = false;
-
-  // No more hits to expect. Form the timeslice and send it down the toolchain
-
-  // Reset the channels min times; they will be recalculated in a moment
-  for (auto& channel : channels) channel.min = channel.max;
-
-  // Prepare the timeslice hits. Store events hitting the time window in
-  // current, the rest in next.
-  for (auto& readout : readouts)
-    for (auto& board : *readout)
-      for (auto& hit : *board)
-        if (hit.time < end)
-          current->push_back(std::move(hit));
-        else {
-          next->push_back(std::move(hit));
-          channels[hit.channel].min = std::min(
-              channels[hit.channel].min, hit.time
-          );
-        };
-  readouts.clear();
+  while (!windows.empty()) {
+    // When the raw readout is at its watermark, don't wait for the lagging
+    // channels: their data may be held back by the watermark itself. Their
+    // late hits go into the following timeslice.
+    bool full = tool.m_data->raw_readout_limit.full();
+    uint64_t end = start + tool.interval;
+    for (auto& channel : channels)
+      if (channel.active && channel.max < end)
+        if (!*channel.digitizer_active)
+          // channel's digitizer went inactive
+          channel.active = false;
+        else if (!full)
+          // some channel may yet provide data fitting the current time window
+          return;
 
-  // Copy the hits and send the timeslice
-  send(*current);
-  current->clear();
-  std::swap(current, next);
+    pop_window();
+  };
+}
 
-  time_min = std::numeric_limits<uint64_t>().max();
-  for (auto& channel : channels)
-    if (channel.active)
-      time_min = std::min(time_min, channel.min);
+// Sends the first pending window
+void Reformatter::ThreadArgs::pop_window() {
+  std::unique_ptr<HitBlock> hits = std::move(windows.front());
+  windows.pop_front();
+  start += tool.interval;
+
+  tool.m_data->raw_readout_limit.remove(*hits);
+  if (!hits->hits.empty())
+    // Hits come in readout order; put them in time order
+    if (merge(*hits, *merged))
+      send(*hits);
+    else {
+      send(*merged);
+      merged->clear();
+    };
+  hits->clear();
+  tool.m_data->hit_blocks.put(std::move(hits));
 }
 
 Reformatter::ThreadArgs::~ThreadArgs() {
   // Send the last hits for processing
-  if (!next->empty()) send(*next);
+  while (!windows.empty()) pop_window();
 }
 
 void Reformatter::Thread(Thread_args* args) {
@@ -169,6 +227,28 @@ bool Reformatter::Initialise(std::string configfile, DataModel& data) {
   long double time = 0.1;
   m_variables.Get("interval", time);
   interval = time_from_seconds(time);
+  if (interval == 0)
+    throw std::runtime_error("Reformatter: interval is too small");
+
+  QueueLimit& limit = m_data->pre_sort_limit;
+  limit.max_bytes = 1ul << 30;
+  m_variables.Get("pre_sort_max_hits",  limit.max_hits);
+  m_variables.Get("pre_sort_max_bytes", limit.max_bytes);
+  std::string policy = "block";
+  m_variables.Get("pre_sort_policy", policy);
+  limit.policy = QueueLimit::parse_policy(policy);
+  limit.spill_path = "pre_sort.spill";
+  m_variables.Get("pre_sort_spill", limit.spill_path);
+
+  int seconds = 5;
+  m_variables.Get("monitor_interval", seconds);
+  monitor_interval = std::chrono::seconds(seconds);
+
+  // Timeslices are large; keep only a few of them for reuse
+  m_data->timeslices.capacity = 16;
+  m_variables.Get("timeslice_pool", m_data->timeslices.capacity);
+
+  stopping = false;
 
   thread = new ThreadArgs(*this);
   util.CreateThread("Reformatter", &Thread, thread);
@@ -182,6 +262,7 @@ bool Reformatter::Execute() {
 }
 
 bool Reformatter::Finalise() {
+  stopping = true;
   util.KillThread(thread);
   delete thread;
   return true;
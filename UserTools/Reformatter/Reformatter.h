@@ -1,11 +1,16 @@
 #ifndef Reformatter_H
 #define Reformatter_H
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <string>
 #include <iostream>
 
 #include "Tool.h"
 
+#include "TimeMerge.h"
+
 class Reformatter: public ToolFramework::Tool {
   public:
     Reformatter();
@@ -17,8 +22,7 @@ class Reformatter: public ToolFramework::Tool {
   private:
     struct ThreadArgs : Thread_args {
       struct Channel {
-        // hit times available in next or readout
-        uint64_t min;
+        // latest hit time seen in this channel
         uint64_t max;
 
         // pointer to the digitizer status (see DataModel::active_digitizers)
@@ -30,43 +34,45 @@ class Reformatter: public ToolFramework::Tool {
         bool active;
       };
 
-      Reformatter& tool;
+      // maximal number of pending windows
+      static const uint64_t max_windows = 4096;
 
-      std::unique_ptr<std::vector<Hit>> current;
-      std::unique_ptr<std::vector<Hit>> next;
+      Reformatter& tool;
 
-      std::vector<
-        std::unique_ptr<
-          std::list<
-            std::unique_ptr<
-              std::vector<Hit>
-            >
-          >
-        >
-      > readouts;
+      // Hits of the pending time windows. windows[i] covers
+      // [start + i * interval, start + (i + 1) * interval).
+      std::deque<std::unique_ptr<HitBlock>> windows;
+      uint64_t start   = 0;
+      bool     started = false;
 
       std::vector<Channel> channels;
 
-      // time of the earliest hit in next or readout (min(channels.min))
-      uint64_t time_min = std::numeric_limits<uint64_t>().max();
-      // time of the latest hit in next or readout (max(channels.max))
-      uint64_t time_max = 0;
+      // time ordering of the windows
+      TimeMerge                 merge;
+      std::unique_ptr<HitBlock> merged;
 
-      ThreadArgs(Reformatter& tool):
-        tool(tool),
-        current(new std::vector<Hit>()),
-        next(new std::vector<Hit>())
-      {};
+      ThreadArgs(Reformatter& tool): tool(tool), merged(new HitBlock) {};
 
       ~ThreadArgs();
 
-      void send(const std::vector<Hit>& hits);
+      // next time to send the monitoring data
+      std::chrono::steady_clock::time_point next_report;
+
+      HitBlock& window(uint64_t time);
+      void pop_window();
+      void send(HitBlock& hits);
+      void report();
       void execute();
     };
 
     // target timeslice length
     uint64_t interval;
 
+    std::chrono::seconds monitor_interval;
+
+    // set in Finalise to stop waiting below the pre_sort_queue watermarks
+    std::atomic<bool> stopping {false};
+
     Utilities util;
     ThreadArgs* thread;
 
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <limits>
+
+#include "TimeMerge.h"
+
+// True if leaf a goes before leaf b
+inline bool TimeMerge::before(uint32_t a, uint32_t b) const {
+  // bitwise operators keep this branch free; the outcome is unpredictable
+  return (keys[a] < keys[b]) | ((keys[a] == keys[b]) & (a < b));
+}
+
+// Plays the tournament from leaf `leaf` up to the root
+inline void TimeMerge::replay(uint32_t leaf) {
+  uint32_t winner = leaf;
+  for (uint32_t node = (leaf + leaves) / 2; node > 0; node /= 2) {
+    uint32_t loser = tree[node];
+    bool swap = before(loser, winner);
+    tree[node] = swap ? winner : loser;
+    winner     = swap ? loser  : winner;
+  };
+  tree[0] = winner;
+}
+
+bool TimeMerge::operator()(const HitBlock& in, HitBlock& out) {
+  const std::vector<Hit>& hits = in.hits;
+  size_t n = hits.size();
+  if (n < 2) return true;
+
+  // Count the hits per channel and check the ordering
+  std::fill(offsets, offsets + 257, 0);
+  uint64_t last[256];
+  bool     channel_sorted[256];
+  std::fill(channel_sorted, channel_sorted + 256, true);
+  bool sorted = true;
+  for (size_t i = 0; i < n; ++i) {
+    const Hit& hit = hits[i];
+    if (i && hit.time < hits[i - 1].time) sorted = false;
+    uint32_t& count = offsets[hit.channel + 1];
+    if (count && hit.time < last[hit.channel])
+      channel_sorted[hit.channel] = false;
+    last[hit.channel] = hit.time;
+    ++count;
+  };
+  if (sorted) return true;
+
+  // Group the hits by channel, so that the merge reads each channel
+  // sequentially
+  for (int c = 0; c < 256; ++c) offsets[c + 1] += offsets[c];
+  grouped.resize(n);
+  std::copy(offsets, offsets + 256, position);
+  for (size_t i = 0; i < n; ++i) grouped[position[hits[i].channel]++] = hits[i];
+
+  // Build the loser tree over the channels. Exhausted channels get the
+  // maximal key; the merge stops after n hits anyway.
+  leaves = 1;
+  while (leaves < 256 && offsets[leaves] < n) leaves <<= 1;
+  keys.assign(leaves, std::numeric_limits<uint64_t>::max());
+  for (uint32_t c = 0; c < leaves; ++c) {
+    uint32_t begin = offsets[c];
+    uint32_t end   = offsets[c + 1];
+    if (begin == end) continue;
+    if (!channel_sorted[c])
+      std::stable_sort(
+          grouped.begin() + begin, grouped.begin() + end,
+          [](const Hit& a, const Hit& b) { return a.time < b.time; }
+      );
+    keys[c] = grouped[begin].time;
+  };
+  std::copy(offsets, offsets + leaves, position);
+  tree.assign(leaves, 0);
+  {
+    // initial tournament: winners[node] is the winner of the subtree
+    std::vector<uint32_t> winners(2 * leaves);
+    for (uint32_t c = 0; c < leaves; ++c) winners[leaves + c] = c;
+    for (uint32_t node = leaves - 1; node > 0; --node) {
+      uint32_t a = winners[2 * node];
+      uint32_t b = winners[2 * node + 1];
+      if (before(a, b)) {
+        winners[node] = a;
+        tree[node]    = b;
+      } else {
+        winners[node] = b;
+        tree[node]    = a;
+      };
+    };
+    tree[0] = winners[1];
+  };
+
+  // Merge
+  size_t base = out.hits.size();
+  out.hits.resize(base + n);
+  Hit* result = out.hits.data() + base;
+  bool waveforms = !in.waveforms.empty();
+  if (waveforms)
+    out.waveforms.reserve(out.waveforms.size() + in.waveforms.size());
+  for (size_t i = 0; i < n; ++i) {
+    uint32_t c = tree[0];
+    Hit& hit = result[i];
+    hit = grouped[position[c]++];
+    if (waveforms && hit.waveform_length) {
+      const uint16_t* samples = in.waveform(hit);
+      hit.waveform_offset = out.waveforms.size();
+      out.waveforms.insert(
+          out.waveforms.end(), samples, samples + hit.waveform_length
+      );
+    };
+    keys[c] = position[c] < offsets[c + 1]
+            ? grouped[position[c]].time
+            : std::numeric_limits<uint64_t>::max();
+    replay(c);
+  };
+
+  return false;
+}
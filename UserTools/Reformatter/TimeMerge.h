@@ -0,0 +1,46 @@
+#ifndef TimeMerge_H
+#define TimeMerge_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Hit.h"
+
+// Puts the hits of a block in time order. The hits of each channel come from
+// a time ordered stream, so the block is a mix of up to 256 ordered
+// sequences. They are separated by channel in O(n) and merged with a loser
+// tree in O(n log k), k being the number of channels. A channel
+// sequence that happens to be out of order (e.g., because of late hits) is
+// sorted on its own first. Ties are broken by the channel number, so the
+// result does not depend on the readout order.
+//
+// The object keeps its scratch buffers between the calls.
+class TimeMerge {
+  public:
+    // Returns true if `in` is already in time order; `out` is left untouched
+    // in this case. Otherwise appends the hits of `in` to `out` in time order
+    // and returns false.
+    bool operator()(const HitBlock& in, HitBlock& out);
+
+  private:
+    // hits grouped by channel
+    std::vector<Hit> grouped;
+
+    // channel c occupies grouped[offsets[c] .. offsets[c + 1])
+    uint32_t offsets[257];
+    // next hit of each channel in grouped
+    uint32_t position[256];
+
+    // Loser tree: keys[c] is the time of the next hit of channel c, tree[0]
+    // is the channel with the earliest next hit, tree[1 .. leaves) are the
+    // losers of the internal nodes.
+    uint32_t              leaves;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> tree;
+
+    bool before(uint32_t a, uint32_t b) const;
+    void replay(uint32_t leaf);
+};
+
+#endif
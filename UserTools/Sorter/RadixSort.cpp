@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+#include "RadixSort.h"
+
+RadixSort::RadixSort(
+    Executor& executor, unsigned threads, Executor::Stats* stats
+):
+  executor(executor),
+  nthreads(std::max(threads, 1u)),
+  stats(stats)
+{}
+
+void RadixSort::run(unsigned size, const std::function<void(unsigned)>& job) {
+  if (size <= 1) {
+    job(0);
+    return;
+  };
+
+  std::mutex mutex;
+  std::condition_variable done;
+  unsigned pending = size - 1;
+  for (unsigned t = 1; t < size; ++t)
+    executor.submit(
+        [&, t]() {
+          job(t);
+          std::lock_guard<std::mutex> lock(mutex);
+          if (--pending == 0) done.notify_one();
+        },
+        stats
+    );
+
+  job(0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&pending]() { return pending == 0; });
+}
+
+void RadixSort::sort(std::vector<Hit>& hits) {
+  size_t n = hits.size();
+  if (n < 2) return;
+
+  unsigned nteam = n < parallel_threshold ? 1 : nthreads;
+  std::vector<size_t> begin(nteam + 1);
+  for (unsigned t = 0; t <= nteam; ++t) begin[t] = n * t / nteam;
+
+  // Key range
+  std::vector<uint64_t> mins(nteam), maxs(nteam);
+  run(
+      nteam,
+      [&](unsigned t) {
+        uint64_t min = hits[begin[t]].time;
+        uint64_t max = min;
+        for (size_t i = begin[t]; i < begin[t + 1]; ++i) {
+          min = std::min(min, hits[i].time);
+          max = std::max(max, hits[i].time);
+        };
+        mins[t] = min;
+        maxs[t] = max;
+      }
+  );
+  uint64_t min   = *std::min_element(mins.begin(), mins.end());
+  uint64_t range = *std::max_element(maxs.begin(), maxs.end()) - min;
+  if (range == 0) return;
+
+  unsigned bits = 0;
+  while (bits < 64 && range >> bits) ++bits;
+  unsigned passes = (bits + max_digit_bits - 1) / max_digit_bits;
+  unsigned width  = (bits + passes - 1) / passes;
+  size_t   digits = size_t(1) << width;
+  uint64_t mask   = digits - 1;
+
+  scratch.resize(n);
+  counts.resize(nteam * digits);
+  Hit* src = hits.data();
+  Hit* dst = scratch.data();
+
+  for (unsigned shift = 0; shift < bits; shift += width) {
+    // Count the digits of each chunk
+    run(
+        nteam,
+        [&](unsigned t) {
+          size_t* count = counts.data() + t * digits;
+          std::fill(count, count + digits, 0);
+          for (size_t i = begin[t]; i < begin[t + 1]; ++i)
+            ++count[(src[i].time - min) >> shift & mask];
+        }
+    );
+
+    // Skip the pass if all keys have the same digit
+    uint64_t digit = (src[0].time - min) >> shift & mask;
+    size_t same = 0;
+    for (unsigned t = 0; t < nteam; ++t) same += counts[t * digits + digit];
+    if (same == n) continue;
+
+    // Turn the counts into the positions of the chunks in the output: digit
+    // by digit, thread by thread
+    size_t position = 0;
+    for (size_t d = 0; d < digits; ++d)
+      for (unsigned t = 0; t < nteam; ++t) {
+        size_t& count = counts[t * digits + d];
+        size_t c = count;
+        count = position;
+        position += c;
+      };
+
+    // Scatter
+    run(
+        nteam,
+        [&](unsigned t) {
+          size_t* position = counts.data() + t * digits;
+          for (size_t i = begin[t]; i < begin[t + 1]; ++i)
+            dst[position[(src[i].time - min) >> shift & mask]++] = src[i];
+        }
+    );
+
+    std::swap(src, dst);
+  };
+
+  if (src != hits.data()) hits.swap(scratch);
+}
@@ -0,0 +1,53 @@
+#ifndef RadixSort_H
+#define RadixSort_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Executor.h"
+#include "Hit.h"
+
+// Multi-threaded LSD radix sort of hits by time. The keys are the times
+// relative to the earliest hit; hit times in a timeslice are dense, so only
+// the bits spanned by the timeslice are sorted, in passes of up to 11 bits.
+// A pass in which all keys have the same digit is skipped. Each pass counts
+// the digits of a contiguous chunk of hits per thread, then scatters the
+// chunks in parallel, which keeps the sort stable.
+//
+// Hits are moved as a whole; their waveform offsets stay valid.
+class RadixSort {
+  public:
+    // Sorts on up to `threads` threads: the calling thread and jobs in
+    // `executor` (accounted in `stats`). Blocks of less than
+    // `parallel_threshold` hits are sorted by the calling thread alone.
+    RadixSort(
+        Executor&        executor,
+        unsigned         threads = 1,
+        Executor::Stats* stats   = nullptr
+    );
+
+    size_t parallel_threshold = 65536;
+
+    unsigned threads() const { return nthreads; };
+
+    // Must not be called from a job of `executor`
+    void sort(std::vector<Hit>& hits);
+
+  private:
+    static const unsigned max_digit_bits = 11;
+
+    Executor&        executor;
+    unsigned         nthreads;
+    Executor::Stats* stats;
+
+    std::vector<Hit>    scratch;
+    std::vector<size_t> counts; // [thread][digit]
+
+    // Runs job(0) in the calling thread and job(1) .. job(size - 1) in the
+    // executor, and waits for all of them
+    void run(unsigned size, const std::function<void(unsigned)>& job);
+};
+
+#endif
@@ -1,108 +1,164 @@
-#include "Sorter.h"
+#include <algorithm>
 
-Sorter_args::Sorter_args():Thread_args(){}
+#include "DataModel.h"
 
-Sorter_args::~Sorter_args(){}
+#include "Sorter.h"
 
+Sorter::Sorter(): Tool() {}
+
+Sorter::ThreadArgs::ThreadArgs(Sorter& tool, unsigned threads):
+  tool(tool),
+  sort(tool.m_data->executor, threads, &tool.jobs),
+  next_report(std::chrono::steady_clock::now())
+{}
+
+void Sorter::ThreadArgs::report() {
+  auto now = std::chrono::steady_clock::now();
+  if (now < next_report) return;
+  double dt = std::chrono::duration<double>(
+      now - next_report + tool.monitor_interval
+  ).count();
+  next_report = now + tool.monitor_interval;
+
+  uint64_t nhits = tool.hits;
+  double sort_time = tool.sort_time;
+
+  Store data;
+  data.Set("sorter_timeslices", tool.timeslices.load());
+  data.Set("sorter_hits",       nhits);
+  data.Set("sorter_sorted",     tool.sorted.load());
+  // hits per second passing through the Sorter
+  data.Set("sorter_rate", dt > 0 ? (nhits - last_hits) / dt : 0);
+  // hits per second of sorting
+  data.Set("sorter_sort_rate", sort_time > 0 ? nhits / sort_time : 0);
+  last_hits = nhits;
+  tool.jobs.report(data, "sorter_jobs");
+
+  std::string json;
+  data >> json;
+  tool.m_data->services->SendMonitoringData(std::move(json), "Sorter");
+}
 
-Sorter::Sorter():Tool(){}
+void Sorter::ThreadArgs::execute() {
+  if (tool.m_data->services) report();
+
+  std::unique_ptr<TimeSlice> timeslice;
+  {
+    std::unique_lock<std::mutex> lock(tool.m_data->pre_sort_mutex);
+    auto& queue = tool.m_data->pre_sort_queue;
+    // return periodically to let the thread be stopped
+    if (
+        !tool.m_data->pre_sort_cv.wait_for(
+          lock,
+          std::chrono::milliseconds(100),
+          [&queue]() { return !queue.empty(); }
+        )
+    )
+      return;
+    timeslice = std::move(queue.front());
+    queue.pop();
+  };
+  tool.m_data->pre_sort_limit.remove(*timeslice);
+
+  // Check the ordering and look for calibration hits in one pass
+  auto& hits = timeslice->hits;
+  const ChannelMask& calib_channels = tool.m_data->calib_channels;
+  bool in_order = true;
+  bool calib    = false;
+  for (size_t i = 0; i < hits.size(); ++i) {
+    if (i && hits[i].time < hits[i - 1].time) in_order = false;
+    if (calib_channels.test(hits[i].channel)) calib = true;
+  };
+
+  if (!in_order) {
+    auto start = std::chrono::steady_clock::now();
+    sort.sort(hits);
+    tool.sort_time = tool.sort_time + std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+    ).count();
+    ++tool.sorted;
+  };
+  ++tool.timeslices;
+  tool.hits += hits.size();
+
+  std::vector<trigger_type>& triggers = this->triggers;
+  triggers.clear();
+  for (auto trigger : tool.triggers)
+    if (trigger != trigger_type::calib || calib) triggers.push_back(trigger);
+
+  if (triggers.empty()) {
+    // nobody to process the timeslice
+    timeslice->clear();
+    tool.m_data->timeslices.put(std::move(timeslice));
+    return;
+  };
+
+  for (auto trigger : triggers)
+    timeslice->triggers.set(static_cast<size_t>(trigger));
+  timeslice->pending = triggers.size();
+  TimeSlice* slice = timeslice.release();
+  {
+    std::lock_guard<std::mutex> lock(tool.m_data->trigger_queues_mutex);
+    for (auto trigger : triggers)
+      tool.m_data->trigger_queues[trigger].push(slice);
+  };
+  tool.m_data->trigger_queues_cv.notify_all();
+}
 
+void Sorter::Thread(Thread_args* args) {
+  static_cast<ThreadArgs*>(args)->execute();
+}
 
-bool Sorter::Initialise(std::string configfile, DataModel &data){
+bool Sorter::Initialise(std::string configfile, DataModel& data) {
   InitialiseTool(data);
   InitialiseConfiguration(configfile);
 
-  if(!m_variables.Get("verbose",m_verbose)) m_verbose=1;
-
-  m_util=new Utilities();
+  if (!m_variables.Get("verbose", m_verbose)) m_verbose = 1;
+
+  unsigned executor_threads = 0;
+  m_variables.Get("executor_threads", executor_threads);
+  m_data->executor.start(executor_threads);
+
+  unsigned threads = 1;
+  m_variables.Get("threads", threads);
+
+  size_t parallel_threshold = 65536;
+  m_variables.Get("parallel_threshold", parallel_threshold);
+
+  struct {
+    const char*  name;
+    trigger_type type;
+    bool         enabled;
+  } trigger_options[] = {
+    { "trigger_nhits",     trigger_type::nhits,     true  },
+    { "trigger_calib",     trigger_type::calib,     true  },
+    { "trigger_zero_bias", trigger_type::zero_bais, false }
+  };
+  triggers.clear();
+  for (auto& option : trigger_options) {
+    m_variables.Get(option.name, option.enabled);
+    if (option.enabled) triggers.push_back(option.type);
+  };
+
+  int seconds = 5;
+  m_variables.Get("monitor_interval", seconds);
+  monitor_interval = std::chrono::seconds(seconds);
+
+  thread = new ThreadArgs(*this, threads);
+  thread->sort.parallel_threshold = parallel_threshold;
+  util.CreateThread("Sorter", &Thread, thread);
 
-  m_threadnum=0;
-  CreateThread();
-  
-  m_freethreads=1;
-  
   ExportConfiguration();
   return true;
 }
 
-
-bool Sorter::Execute(){
-
-  for(unsigned int i=0; i<args.size(); i++){
-    if(args.at(i)->busy==0){
-      std::cout<<"reply="<<args.at(i)->message<<std::endl;
-      args.at(i)->message="Hi";
-      args.at(i)->busy=1;
-      break;
-    }
-
-  }
-
-  m_freethreads=0;
-  int lastfree=0;
-  for(unsigned int i=0; i<args.size(); i++){
-    if(args.at(i)->busy==0){
-      m_freethreads++;
-      lastfree=i; 
-    }
-  }
-
-  if(m_freethreads<1) CreateThread();
-  if(m_freethreads>1) DeleteThread(lastfree);
-  
-  std::cout<<"free threads="<<m_freethreads<<":"<<args.size()<<std::endl;
-  
-  sleep(1);
-  
+bool Sorter::Execute() {
   return true;
 }
 
-
-bool Sorter::Finalise(){
-
-  for(unsigned int i=0;i<args.size();i++) m_util->KillThread(args.at(i));
-  
-  args.clear();
-  
-  delete m_util;
-  m_util=0;
-
+bool Sorter::Finalise() {
+  util.KillThread(thread);
+  delete thread;
+  thread = nullptr;
   return true;
 }
-
-void Sorter::CreateThread(){
-
-  Sorter_args* tmparg=new Sorter_args();
-  tmparg->busy=0;
-  tmparg->message="";
-  args.push_back(tmparg);
-  std::stringstream tmp;
-  tmp<<"T"<<m_threadnum;
-  m_util->CreateThread(tmp.str(), &Thread, args.at(args.size()-1));
-  m_threadnum++;
-
-}
-
- void Sorter::DeleteThread(int pos){
-
-   m_util->KillThread(args.at(pos));
-   delete args.at(pos);
-   args.at(pos)=0;
-   args.erase(args.begin()+(pos-1));
-
- }
-
-void Sorter::Thread(Thread_args* arg){
-
-  Sorter_args* args=reinterpret_cast<Sorter_args*>(arg);
-
-  if(!args->busy) usleep(100);
-  else{ 
-
-    args->message="Hello";
-    sleep(10);
-
-    args->busy=0;
-  }
-
-}
@@ -1,65 +1,63 @@
 #ifndef Sorter_H
 #define Sorter_H
 
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <iostream>
+#include <vector>
 
 #include "Tool.h"
 
-using namespace ToolFramework;
+#include "RadixSort.h"
 
-/**
- * \struct Sorter_args
- *
- * This is a struct to place data you want your thread to acess or exchange with it. The idea is the datainside is only used by the threa\
-d and so will be thread safe
-*
-* $Author: B.Richards $
-* $Date: 2019/05/28 10:44:00 $
-*/
+// Takes timeslices from DataModel::pre_sort_queue, puts their hits in time
+// order if they are not already, and distributes them into
+// DataModel::trigger_queues for the enabled triggers. The calibration
+// trigger only gets the timeslices with hits in DataModel::calib_channels.
+class Sorter: public ToolFramework::Tool {
+  public:
+    Sorter();
 
-struct Sorter_args:Thread_args{
+    bool Initialise(std::string configfile, DataModel& data);
+    bool Execute();
+    bool Finalise();
 
-  Sorter_args();
-  ~Sorter_args();
-  bool busy;
-  std::string message;
+  private:
+    struct ThreadArgs : Thread_args {
+      Sorter&   tool;
+      RadixSort sort;
 
-};
-
-/**
- * \class Sorter
- *
- * This is a template for a Tool that dynamically more or less threads, such that there is always 1 available thread.This can therefore be used to scale to your worklaod, however be carefull when using more than one of these tools and to apply upperlimits if necessary both locally within this tool and globally so that more threads than is practical are created causing massive inefficency. Please fill out the descripton and author information.
- *
- * $Author: B.Richards $
- * $Date: 2019/05/28 10:44:00 $
- */
+      // next time to send the monitoring data
+      std::chrono::steady_clock::time_point next_report;
+      uint64_t last_hits = 0;
 
-class Sorter: public Tool {
+      // triggers of the current timeslice
+      std::vector<trigger_type> triggers;
 
+      ThreadArgs(Sorter& tool, unsigned threads);
 
- public:
+      void report();
+      void execute();
+    };
 
-  Sorter(); ///< Simple constructor
-  bool Initialise(std::string configfile,DataModel &data); ///< Initialise Function for setting up Tool resorces. @param configfile The path and name of the dynamic configuration file to read in. @param data A reference to the transient data class used to pass information between Tools.
-  bool Execute(); ///< Executre function used to perform Tool perpose. 
-  bool Finalise(); ///< Finalise funciton used to clean up resorces.
+    std::vector<trigger_type> triggers;
 
+    std::chrono::seconds monitor_interval;
 
- private:
+    // counters
+    std::atomic<uint64_t> timeslices {0};
+    std::atomic<uint64_t> hits       {0};
+    std::atomic<uint64_t> sorted     {0}; // timeslices that needed sorting
+    std::atomic<double>   sort_time  {0}; // seconds spent sorting
 
-  void CreateThread(); ///< Function to Create Thread
-  void DeleteThread(int pos); ///< Function to delete thread @param pos is the position in the args vector below
+    // sorting jobs run in DataModel::executor
+    Executor::Stats jobs;
 
-  static void Thread(Thread_args* arg); ///< Function to be run by the thread in a loop. Make sure not to block in it
-  Utilities* m_util; ///< Pointer to utilities class to help with threading
-  std::vector<Sorter_args*> args; ///< Vector of thread args (also holds pointers to the threads)
-
-  int m_freethreads; ///< Keeps track of free threads
-  unsigned long m_threadnum; ///< Counter for unique naming of threads
+    Utilities util;
+    ThreadArgs* thread = nullptr;
 
+    static void Thread(Thread_args*);
 };
 
-
 #endif
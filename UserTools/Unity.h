@@ -6,4 +6,7 @@
 #include "HVoltage.h"
 #include "Digitizer.h"
 #include "Reformatter.h"
+#include "EventBuilder.h"
 
+#include "CodecBenchmark.h"
+#include "HitReplay.h"